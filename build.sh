@@ -1,9 +1,13 @@
+./gen_hotlist.sh hot_symbols.txt gap8_hot.ld || exit 1
+
 riscv32-unknown-elf-gcc -o test \
 startup_gapuino.S \
-gap8_interrupt.c gap8_uart.c gap8_udma.c gap8_gpio.c gap8_tim.c gap8_fll.c \
+gap8_interrupt.c gap8_uart.c gap8_udma.c gap8_gpio.c gap8_tim.c gap8_fll.c gap8_sync.c gap8_workq.c gap8_irqtrace.c gap8_boot.c gap8_icache.c gap8_swtimer.c gap8_perf.c gap8_pcprof.c gap8_dvfs.c gap8_rtc.c gap8_pm.c \
 main_UART.c \
 -g -fno-jump-tables -fno-tree-loop-distribute-patterns \
 -fdata-sections -ffunction-sections \
 -march=rv32imcxgap8 -mPE=8 -mFC=1 -D__riscv__ -D__pulp__ -D__GAP8__ \
 -nostartfiles -Og \
--T GAP8.ld
+-T GAP8.ld \
+-Wl,-Map=test.map && \
+./placement_report.sh test
@@ -0,0 +1,241 @@
+/************************************************************************************
+ * Boot support for GAP8 FC
+ *  Initialized FC TCDM sections are linked to run in FC TCDM but loaded in L2 (see
+ *  GAP8.ld). reset_handler starts copying them with the TCDM uDMA channel, reloads
+ *  L2 .data and clears BSS with the core in the meantime, and then waits for the
+ *  copy to finish.
+ *
+ *  Boot phases are stamped with the cycle counter and the 32kHz FC timer high
+ *  half, both started by reset_handler.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_boot.h"
+#include "gap8_udma.h"
+#include "gap8_perf.h"
+#include "gap8_section.h"
+#include <stdio.h>
+#include <string.h>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* From GAP8.ld */
+extern char __fc_tcdm_load_start__[];
+extern char __fc_tcdm_start__[];
+extern char __fc_tcdm_size__[];
+
+/* Name of the phase ended by each stamp */
+static const char *_phase_names[GAP8_BOOT_NR_STAMPS] = {
+  "reset",
+  "tcdm setup",
+  "data/bss",
+  "tcdm wait",
+  "irq init",
+  "fll lock",
+  "console",
+  "to user",
+};
+
+/* uDMA cannot read FC TCDM, so format the output in L2 */
+static char _linebuf[64] GAP8_L2_DMA;
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* Cleared with FC BSS, filled right after */
+struct gap8_boot_profile_s gap8_boot_profile GAP8_FC_TCDM_BSS;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void _puts(struct gap8_uart_t *uart, const char *str)
+{
+  if (uart)
+    {
+      gap8_uart_sendbytes(uart, (uint8_t*)str, strlen(str));
+    }
+  else
+    {
+      while (*str)
+        {
+          FC_STDOUT->PUTC[0] = *str++;
+        }
+    }
+}
+
+/* 32kHz ticks to us: 1000000/32768 = 15625/512 */
+
+static inline uint32_t _ref_to_us(uint32_t ref)
+{
+  return (uint32_t)(((uint64_t)ref * 15625) >> 9);
+}
+
+/* Format the us between two stamps, or "-" without both 32kHz counts */
+
+static const char *_ref_us(uint32_t from, uint32_t to, char *buf)
+{
+  const struct gap8_boot_profile_s *prof = &gap8_boot_profile;
+  uint32_t both = (1L << from) | (1L << to);
+
+  if ((prof->ref_valid & both) != both)
+    {
+      return "-";
+    }
+
+  sprintf(buf, "%lu",
+          (unsigned long)_ref_to_us(prof->ref[to] - prof->ref[from]));
+
+  return buf;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_boot_tcdm_load_start
+ *
+ * Description:
+ *   Start copying the FC TCDM image from L2. Runs before BSS is cleared, so
+ *   it only touches registers and linker symbols.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_boot_tcdm_load_start(void)
+{
+  uint32_t size = (uint32_t)__fc_tcdm_size__;
+
+  if (size == 0)
+    {
+      return;
+    }
+
+  UDMA_GC->CG |= (1L << GAP8_UDMA_ID_TCDM);
+
+  /* The TX channel reads L2 at TX_SADDR and writes FC TCDM at DST_ADDR */
+
+  TCDM->DST_ADDR = TCDM_DST_ADDR((uint32_t)__fc_tcdm_start__);
+  TCDM->UDMA_TCDM.TX_SADDR = (uint32_t)__fc_tcdm_load_start__;
+  TCDM->UDMA_TCDM.TX_SIZE  = size;
+  TCDM->UDMA_TCDM.TX_CFG   = UDMA_CFG_EN(1);
+}
+
+/****************************************************************************
+ * Name: gap8_boot_tcdm_load_wait
+ *
+ * Description:
+ *   Wait for the TCDM copy and record the stamps taken so far.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_boot_tcdm_load_wait(uint32_t reset_cyc, uint32_t reset_ref,
+                              uint32_t tcdm_cyc, uint32_t tcdm_ref,
+                              uint32_t bss_cyc, uint32_t bss_ref)
+{
+  uint32_t size = (uint32_t)__fc_tcdm_size__;
+
+  if (size != 0)
+    {
+      /* EN and PENDING read back set while the transfer is in flight */
+
+      while (TCDM->UDMA_TCDM.TX_CFG & (UDMA_CFG_EN_MASK | UDMA_CFG_CLR_MASK))
+        ;
+
+      UDMA_GC->CG &= ~(1L << GAP8_UDMA_ID_TCDM);
+    }
+
+  gap8_boot_stamp(GAP8_BOOT_TCDM_DONE);
+
+  gap8_boot_profile.cycles[GAP8_BOOT_RESET] = reset_cyc;
+  gap8_boot_profile.ref[GAP8_BOOT_RESET] = reset_ref;
+  gap8_boot_profile.cycles[GAP8_BOOT_TCDM_START] = tcdm_cyc;
+  gap8_boot_profile.ref[GAP8_BOOT_TCDM_START] = tcdm_ref;
+  gap8_boot_profile.cycles[GAP8_BOOT_BSS_DONE] = bss_cyc;
+  gap8_boot_profile.ref[GAP8_BOOT_BSS_DONE] = bss_ref;
+  gap8_boot_profile.valid |= (1L << GAP8_BOOT_RESET) |
+                             (1L << GAP8_BOOT_TCDM_START) |
+                             (1L << GAP8_BOOT_BSS_DONE);
+  gap8_boot_profile.ref_valid |= (1L << GAP8_BOOT_RESET) |
+                                 (1L << GAP8_BOOT_TCDM_START) |
+                                 (1L << GAP8_BOOT_BSS_DONE);
+  gap8_boot_profile.tcdm_bytes = size;
+}
+
+/****************************************************************************
+ * Name: gap8_boot_stamp
+ *
+ * Description:
+ *   Stamp the end of a boot phase. Only the first stamp of each phase is
+ *   kept, and `ref` only while the high half counts the 32kHz reference.
+ *
+ ****************************************************************************/
+
+void gap8_boot_stamp(enum gap8_boot_stamp_e stamp)
+{
+  if (stamp >= GAP8_BOOT_NR_STAMPS ||
+      (gap8_boot_profile.valid & (1L << stamp)))
+    {
+      return;
+    }
+
+  gap8_boot_profile.cycles[stamp] = gap8_perf_read();
+  if ((BASIC_TIM->CFG_REG_HI & BASIC_TIM_CLKSRC_32K) &&
+      !(BASIC_TIM->CFG_REG_LO & BASIC_TIM_CASC_ENABLE))
+    {
+      gap8_boot_profile.ref[stamp] = BASIC_TIM->VALUE_HI;
+      gap8_boot_profile.ref_valid |= (1L << stamp);
+    }
+  gap8_boot_profile.valid |= (1L << stamp);
+}
+
+/****************************************************************************
+ * Name: gap8_boot_dump
+ *
+ * Description:
+ *   Print the time spent in each boot phase on `uart`, or on the debug
+ *   bridge stdout if `uart` is NULL.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_boot_dump(struct gap8_uart_t *uart)
+{
+  struct gap8_boot_profile_s *prof = &gap8_boot_profile;
+  int i, prev = GAP8_BOOT_RESET;
+  char us[12];
+
+  sprintf(_linebuf, "boot phases: cycles us (TCDM image %lu bytes)\r\n",
+          (unsigned long)prof->tcdm_bytes);
+  _puts(uart, _linebuf);
+
+  for (i = GAP8_BOOT_RESET + 1; i < GAP8_BOOT_NR_STAMPS; i++)
+    {
+      if ((prof->valid & (1L << i)) == 0)
+        {
+          continue;
+        }
+
+      sprintf(_linebuf, "  %-12s %10lu %8s\r\n", _phase_names[i],
+              (unsigned long)(prof->cycles[i] - prof->cycles[prev]),
+              _ref_us(prev, i, us));
+      _puts(uart, _linebuf);
+      prev = i;
+    }
+
+  sprintf(_linebuf, "  %-12s %10lu %8s\r\n", "total",
+          (unsigned long)(prof->cycles[prev] - prof->cycles[GAP8_BOOT_RESET]),
+          _ref_us(GAP8_BOOT_RESET, prev, us));
+  _puts(uart, _linebuf);
+}
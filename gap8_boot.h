@@ -0,0 +1,121 @@
+/************************************************************************************
+ * Boot support for GAP8 FC
+ *  Initialized FC TCDM sections are linked to run in FC TCDM but loaded in L2 (see
+ *  GAP8.ld). reset_handler starts copying them with the TCDM uDMA channel, reloads
+ *  L2 .data and clears BSS with the core in the meantime, and then waits for the
+ *  copy to finish.
+ *
+ *  Boot profiler: reset_handler starts the cycle counter, and the high half of the
+ *  FC timer on the 32kHz reference clock, which keeps real time across FLL
+ *  changes. Every boot phase is stamped with both, from reset to the first user
+ *  code. Stamps taken before BSS is cleared are held in registers, then all of
+ *  them land in `gap8_boot_profile` in FC BSS, which the debug bridge could also
+ *  read directly. gap8_timer_hi_initialize() and cascaded mode take the high half
+ *  over: stamps after them have no 32kHz count, and the dump prints "-".
+ *
+ *  The phases after main() are stamped by the application, in order:
+ *
+ *    up_irqinitialize();
+ *    gap8_boot_stamp(GAP8_BOOT_IRQ_INIT);
+ *    gap8_setfreq(...);
+ *    gap8_boot_stamp(GAP8_BOOT_FLL_LOCK);
+ *    ...
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_BOOT_H
+#define GAP8_BOOT_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include "gap8_uart.h"
+#include <stdint.h>
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+/* Boot stamps, each one ends a phase */
+enum gap8_boot_stamp_e {
+  GAP8_BOOT_RESET = 0,      /* reset_handler entry        */
+  GAP8_BOOT_TCDM_START,     /* TCDM uDMA copy started     */
+  GAP8_BOOT_BSS_DONE,       /* .data loaded, BSS cleared  */
+  GAP8_BOOT_TCDM_DONE,      /* TCDM copy finished, main() */
+  GAP8_BOOT_IRQ_INIT,       /* up_irqinitialize() done    */
+  GAP8_BOOT_FLL_LOCK,       /* gap8_setfreq() locked      */
+  GAP8_BOOT_CONSOLE,        /* UART initialized           */
+  GAP8_BOOT_USER,           /* first user code            */
+  GAP8_BOOT_NR_STAMPS
+};
+
+struct gap8_boot_profile_s {
+  uint32_t cycles[GAP8_BOOT_NR_STAMPS];   /* core cycles since reset      */
+  uint32_t ref[GAP8_BOOT_NR_STAMPS];      /* 32kHz ticks since reset      */
+  uint32_t valid;                         /* bitmap of stamps taken       */
+  uint32_t ref_valid;                     /* bitmap of `ref` taken        */
+  uint32_t tcdm_bytes;                    /* size of the TCDM image       */
+};
+
+/************************************************************************************
+ * Public Data
+ ************************************************************************************/
+
+extern struct gap8_boot_profile_s gap8_boot_profile;
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_boot_tcdm_load_start
+ *
+ * Description:
+ *   Called by reset_handler before clearing BSS. Start copying the FC TCDM
+ *   image from L2. Neither .data, BSS nor FC TCDM data may be used yet.
+ *
+ ****************************************************************************/
+
+void gap8_boot_tcdm_load_start(void);
+
+/****************************************************************************
+ * Name: gap8_boot_tcdm_load_wait
+ *
+ * Description:
+ *   Called by reset_handler after clearing BSS, with the (cycles, ref)
+ *   stamps taken so far. Wait for the TCDM copy and record the stamps.
+ *
+ ****************************************************************************/
+
+void gap8_boot_tcdm_load_wait(uint32_t reset_cyc, uint32_t reset_ref,
+                              uint32_t tcdm_cyc, uint32_t tcdm_ref,
+                              uint32_t bss_cyc, uint32_t bss_ref);
+
+/****************************************************************************
+ * Name: gap8_boot_stamp
+ *
+ * Description:
+ *   Stamp the end of a boot phase. Only the first stamp of each phase is
+ *   kept. Once gap8_timer_hi_initialize() or cascaded mode takes the high
+ *   half of the timer off the 32kHz reference, only cycles are recorded.
+ *
+ ****************************************************************************/
+
+void gap8_boot_stamp(enum gap8_boot_stamp_e stamp);
+
+/****************************************************************************
+ * Name: gap8_boot_dump
+ *
+ * Description:
+ *   Print the time spent in each boot phase on `uart`, or on the debug
+ *   bridge stdout if `uart` is NULL.
+ *
+ ****************************************************************************/
+
+void gap8_boot_dump(struct gap8_uart_t *uart);
+
+#endif
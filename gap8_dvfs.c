@@ -0,0 +1,342 @@
+/************************************************************************************
+ * DVFS governor of GAP8 FC
+ *  Steps frequency and voltage between operating points, by the idle time
+ *  accounted in the event unit sleep path.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_dvfs.h"
+#include "gap8_interrupt.h"
+#include "gap8_fll.h"
+#include "gap8_tim.h"
+#include "gap8_udma.h"
+#include "gap8_pm.h"
+#include "gap8_section.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Range of the DCDC setting */
+#define DCDC_MIN_MV       550
+#define DCDC_MAX_MV       2100
+
+/* Time for the rail to settle after raising the voltage, conservative */
+#define DCDC_SETTLE_US    100
+
+/* Longest wait for the uDMA transfers in flight before a switch */
+#define DVFS_QUIESCE_US   2000
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct {
+  const struct gap8_dvfs_opp_s *opps;
+  uint32_t nopps;
+  uint32_t up_pct;
+  uint32_t down_pct;
+  volatile uint32_t *clock;     /* free running, at the FLL rate */
+  uint32_t window_start;
+  uint32_t window_idle;         /* gap8_idle_cycles at window start */
+  struct gap8_dvfs_stats_s stats;
+} _dvfs;
+
+/* uDMA cannot read FC TCDM, so format the output in L2 */
+static char _linebuf[64] GAP8_L2_DMA;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void _set_voltage(uint32_t mv)
+{
+  uint32_t old_mv = gap8_pm_get_voltage();
+  uint32_t start, cycles;
+
+  if (mv == old_mv)
+    {
+      return;
+    }
+
+  gap8_pm_set_voltage(mv);
+
+  /* Going up, the rail must be there before the frequency */
+
+  if (mv > old_mv)
+    {
+      cycles = (gap8_getfreq() / 1000000) * DCDC_SETTLE_US;
+      start = *_dvfs.clock;
+      while (*_dvfs.clock - start < cycles)
+        ;
+    }
+}
+
+/* Spin until the uDMA has no transfer in flight, and return with IRQ
+ * disabled so that none starts. Give up after DVFS_QUIESCE_US. */
+
+static bool _quiesce(uint32_t *flags)
+{
+  uint32_t cycles = (gap8_getfreq() / 1000000) * DVFS_QUIESCE_US;
+  uint32_t start = *_dvfs.clock;
+
+  for (; ; )
+    {
+      *flags = up_irq_save();
+      if (!gap8_udma_busy())
+        {
+          return true;
+        }
+      up_irq_restore(*flags);
+
+      if (*_dvfs.clock - start >= cycles)
+        {
+          return false;
+        }
+    }
+}
+
+/* Voltage first going up, frequency first going down. The clock changes
+ * between uDMA transfers, as the peripheral dividers follow it from the
+ * FLL notifiers. Return false, at the same point, if the uDMA kept busy or
+ * the FLL refused. */
+
+static bool _switch(uint32_t to)
+{
+  const struct gap8_dvfs_opp_s *opp = &_dvfs.opps[to];
+  uint32_t old_mv = gap8_pm_get_voltage();
+  uint32_t flags;
+  int ret = ERROR;
+
+  /* Let a retune started elsewhere finish first */
+
+  while (!gap8_fll_poll())
+    ;
+
+  if (opp->mv > old_mv)
+    {
+      _set_voltage(opp->mv);
+    }
+
+  if (_quiesce(&flags))
+    {
+      ret = gap8_setfreq_start(opp->hz, NULL);
+      up_irq_restore(flags);
+    }
+
+  if (ret != OK)
+    {
+      _set_voltage(old_mv);
+      return false;
+    }
+
+  while (!gap8_fll_poll())
+    ;
+
+  if (opp->mv < old_mv)
+    {
+      _set_voltage(opp->mv);
+    }
+
+  _dvfs.stats.opp = to;
+
+  return true;
+}
+
+static void _restart_window(void)
+{
+  _dvfs.window_start = *_dvfs.clock;
+  _dvfs.window_idle = gap8_idle_cycles;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_dvfs_initialize
+ *
+ * Description:
+ *   Start governing from the operating point closest to the current
+ *   frequency.
+ *
+ ****************************************************************************/
+
+int gap8_dvfs_initialize(const struct gap8_dvfs_opp_s *opps, uint32_t nopps,
+                         uint32_t up_pct, uint32_t down_pct)
+{
+  uint32_t hz = gap8_getfreq();
+  uint32_t best = 0, best_err = UINT32_MAX, err, i;
+
+  if (opps == NULL || nopps == 0 || nopps > GAP8_DVFS_MAX_OPPS ||
+      up_pct > 100 || down_pct >= up_pct)
+    {
+      return ERROR;
+    }
+
+  for (i = 0; i < nopps; i++)
+    {
+      if ((i > 0 && opps[i].hz <= opps[i - 1].hz) ||
+          opps[i].mv < DCDC_MIN_MV || opps[i].mv > DCDC_MAX_MV)
+        {
+          return ERROR;
+        }
+
+      err = opps[i].hz > hz ? opps[i].hz - hz : hz - opps[i].hz;
+      if (err < best_err)
+        {
+          best = i;
+          best_err = err;
+        }
+    }
+
+  /* A free running counter at the FLL rate */
+
+  if (gap8_clock_hz())
+    {
+      _dvfs.clock = &BASIC_TIM->VALUE_LO;
+    }
+  else if (gap8_timer_hi_us_to_cycles(1000000))
+    {
+      _dvfs.clock = &BASIC_TIM->VALUE_HI;
+    }
+  else
+    {
+      return ERROR;
+    }
+
+  _dvfs.opps = opps;
+  _dvfs.nopps = nopps;
+  _dvfs.up_pct = up_pct;
+  _dvfs.down_pct = down_pct;
+  memset(&_dvfs.stats, 0, sizeof(_dvfs.stats));
+
+  if (!_switch(best))
+    {
+      _dvfs.opps = NULL;
+      return ERROR;
+    }
+
+  gap8_idle_clock = _dvfs.clock;
+  _restart_window();
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_dvfs_sample
+ *
+ * Description:
+ *   Close the current window, account it, and step one operating point if
+ *   the load calls for it. Thread level only: it spins for the uDMA, the
+ *   regulator and the FLL.
+ *
+ ****************************************************************************/
+
+int gap8_dvfs_sample(void)
+{
+  struct gap8_dvfs_stats_s *stats = &_dvfs.stats;
+  const struct gap8_dvfs_opp_s *opp;
+  uint32_t total, idle, load, to;
+
+  if (_dvfs.opps == NULL || up_interrupt_context())
+    {
+      return ERROR;
+    }
+
+  opp = &_dvfs.opps[stats->opp];
+  idle = gap8_idle_cycles - _dvfs.window_idle;
+  total = *_dvfs.clock - _dvfs.window_start;
+  if (total == 0)
+    {
+      return OK;
+    }
+  if (idle > total)
+    {
+      idle = total;
+    }
+
+  load = (uint32_t)(((uint64_t)(total - idle) * 100) / total);
+  stats->load_pct = load;
+  stats->time_us[stats->opp] += ((uint64_t)total * 1000000) / opp->hz;
+
+  /* Going down, the same work takes proportionally more of the window */
+
+  to = stats->opp;
+  if (load > _dvfs.up_pct && to + 1 < _dvfs.nopps)
+    {
+      to++;
+    }
+  else if (load < _dvfs.down_pct && to > 0 &&
+           (uint64_t)load * opp->hz <
+           (uint64_t)_dvfs.up_pct * _dvfs.opps[to - 1].hz)
+    {
+      to--;
+    }
+
+  if (to != stats->opp)
+    {
+      if (_switch(to))
+        {
+          stats->transitions++;
+        }
+      else
+        {
+          stats->deferred++;
+        }
+    }
+
+  _restart_window();
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_dvfs_getstats
+ *
+ * Description:
+ *   Copy the statistics since initialization.
+ *
+ ****************************************************************************/
+
+void gap8_dvfs_getstats(struct gap8_dvfs_stats_s *stats)
+{
+  *stats = _dvfs.stats;
+}
+
+/****************************************************************************
+ * Name: gap8_dvfs_dump
+ *
+ * Description:
+ *   Print the time spent at each operating point on `uart`.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_dvfs_dump(struct gap8_uart_t *uart)
+{
+  struct gap8_dvfs_stats_s stats = _dvfs.stats;
+  uint32_t i;
+
+  sprintf(_linebuf, "dvfs opp %lu load %lu%% transitions %lu deferred %lu\r\n",
+          (unsigned long)stats.opp, (unsigned long)stats.load_pct,
+          (unsigned long)stats.transitions, (unsigned long)stats.deferred);
+  gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+
+  for (i = 0; i < _dvfs.nopps; i++)
+    {
+      sprintf(_linebuf, "%10luHz %4lumV %10lums\r\n",
+              (unsigned long)_dvfs.opps[i].hz, (unsigned long)_dvfs.opps[i].mv,
+              (unsigned long)(stats.time_us[i] / 1000));
+      gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+    }
+}
@@ -0,0 +1,139 @@
+/************************************************************************************
+ * DVFS governor of GAP8 FC
+ *  FC can run up to 250MHz@1.2V, but only 150MHz@1.0V. The governor steps between
+ *  operating points given by the application, each a frequency and the lowest
+ *  voltage it runs at, so that the FC gets throughput when loaded and saves power
+ *  when idle.
+ *
+ *  The load is the share of time out of gap8_sleep_wait_sw_evnt(), measured on a
+ *  free running counter at the FLL rate: the high half of the timer, or the
+ *  cascaded clock. IRQ handled while asleep count as load. Each
+ *  gap8_dvfs_sample() closes a window and moves one point:
+ *  - up, if the load is above `up_pct`;
+ *  - down, if the load is below `down_pct`, and would stay below `up_pct` at the
+ *    lower point, so that it does not bounce back on the next window.
+ *  The voltage is raised before the frequency, and lowered after it.
+ *
+ *    static const struct gap8_dvfs_opp_s opps[] = {
+ *      {  50000000, 1000 },
+ *      { 150000000, 1000 },
+ *      { 250000000, 1200 },
+ *    };
+ *
+ *    static struct gap8_swtimer_s dvfs_timer;
+ *    static volatile bool sample_due;
+ *    static void on_tick(void *arg) { sample_due = true; }
+ *
+ *    gap8_timer_hi_initialize(freq);
+ *    gap8_dvfs_initialize(opps, 3, 80, 30);
+ *    gap8_swtimer_init(&dvfs_timer, on_tick, NULL);
+ *    gap8_swtimer_start(&dvfs_timer, 10, 10);    every 100ms, at a 100Hz tick
+ *    while (1)
+ *      {
+ *        if (sample_due)
+ *          {
+ *            sample_due = false;
+ *            gap8_dvfs_sample();
+ *          }
+ *        ...  main loop
+ *      }
+ *
+ *  Sampling spins for the regulator and the FLL, so call it at thread level, as
+ *  above: timer callbacks and work queues run in IRQ. A switch waits for the
+ *  uDMA transfers in flight to end, and starts no new one until the clock has
+ *  changed, so that no transfer sees its peripheral divider change. If the uDMA
+ *  keeps busy, e.g. a receive always pending, the switch is deferred to the next
+ *  sample. A window must stay below 2^32 cycles, ~17s at 250MHz.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_DVFS_H
+#define GAP8_DVFS_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include "gap8_uart.h"
+#include <stdint.h>
+
+/************************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************************/
+
+#define GAP8_DVFS_MAX_OPPS  8
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+/* Operating point */
+
+struct gap8_dvfs_opp_s {
+  uint32_t hz;
+  uint32_t mv;                          /* DCDC, 550 to 2100 by 50 */
+};
+
+struct gap8_dvfs_stats_s {
+  uint32_t opp;                         /* current operating point */
+  uint32_t load_pct;                    /* load of the last window */
+  uint32_t transitions;
+  uint32_t deferred;                    /* switches put off: uDMA busy, or FLL */
+  uint64_t time_us[GAP8_DVFS_MAX_OPPS]; /* time spent at each point */
+};
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_dvfs_initialize
+ *
+ * Description:
+ *   Start governing over `nopps` operating points, sorted by frequency,
+ *   from the one closest to the current frequency. The table must stay
+ *   valid. Return ERROR on a bad table or thresholds, if neither the
+ *   high half of the timer nor the cascaded clock runs, or if the first
+ *   switch could not be made.
+ *
+ ****************************************************************************/
+
+int gap8_dvfs_initialize(const struct gap8_dvfs_opp_s *opps, uint32_t nopps,
+                         uint32_t up_pct, uint32_t down_pct);
+
+/****************************************************************************
+ * Name: gap8_dvfs_sample
+ *
+ * Description:
+ *   Close the current window, account it, and step one operating point if
+ *   the load calls for it. Return ERROR if not initialized, or called in
+ *   IRQ: thread level only.
+ *
+ ****************************************************************************/
+
+int gap8_dvfs_sample(void);
+
+/****************************************************************************
+ * Name: gap8_dvfs_getstats
+ *
+ * Description:
+ *   Copy the statistics since initialization.
+ *
+ ****************************************************************************/
+
+void gap8_dvfs_getstats(struct gap8_dvfs_stats_s *stats);
+
+/****************************************************************************
+ * Name: gap8_dvfs_dump
+ *
+ * Description:
+ *   Print the time spent at each operating point on `uart`.
+ *
+ ****************************************************************************/
+
+void gap8_dvfs_dump(struct gap8_uart_t *uart);
+
+#endif
@@ -1,7 +1,8 @@
 /************************************************************************************
  * GAP8 FLL clock generater
  *  FC can run up to 250MHz@1.2V, and 150MHz@1.0V. While the default voltage of PMU
- *  is 1.2V, it's okay to boost up without considering PMU.
+ *  is 1.2V, it's okay to boost up without considering PMU. gap8_dvfs.h pairs them
+ *  to run lower voltages.
  * 
  * Author: hhuysqt <1020988872@qq.com>
  * 
@@ -12,6 +13,11 @@
  ************************************************************************************/
 
 #include "gap8_fll.h"
+#include "gap8_interrupt.h"
+#include "gap8_sync.h"
+#include "gap8_section.h"
+#include <stddef.h>
+#include <stdbool.h>
 
 /************************************************************************************
  * Pre-Processor Declarations
@@ -20,59 +26,356 @@
 /* Log2(FLL_REF_CLK=32768) */
 #define LOG2_REFCLK     15
 
+/* Highest DCO frequency, Fref * mult */
+#define DCO_MAX_HZ      (1UL << 29)
+
+/* Largest output divider, 2^(div-1) with a 4-bit div */
+#define MAX_DIV         15
+
+/* Settings remembered for frequent switches */
+#define NR_CACHED       4
+
+/* Locked when the status is this close to the multiplier */
+#define LOCK_TOLERANCE  0x10
+
+/* Both FLL have the same registers */
+#define SOC_FLL         ((struct fll_regs_s *)&FLL_CTRL->SOC_FLL_STATUS)
+#define CLUSTER_FLL     ((struct fll_regs_s *)&FLL_CTRL->CLUSTER_FLL_STATUS)
+
+/* Index of _retune */
+#define FLL_SOC         0
+#define FLL_CLUSTER     1
+
+/* CONF2 with a given loop gain: 2^-7 while locking, 2^-11 once locked */
+#define FLL_CONF2(gain) \
+  (FLL_CTRL_CONF2_LOOPGAIN(gain)         | \
+   FLL_CTRL_CONF2_DEASSERT_CYCLES(0x10)  | \
+   FLL_CTRL_CONF2_ASSERT_CYCLES(0x10)    | \
+   FLL_CTRL_CONF2_LOCK_TOLERANCE(0x100)  | \
+   FLL_CTRL_CONF2_CONF_CLK_SEL(0x0)      | \
+   FLL_CTRL_CONF2_OPEN_LOOP(0x0)         | \
+   FLL_CTRL_CONF2_DITHERING(0x1))
+
+/************************************************************************************
+ * Private Types
+ ************************************************************************************/
+
+struct fll_regs_s {
+  volatile uint32_t STATUS;
+  volatile uint32_t CONF1;
+  volatile uint32_t CONF2;
+  volatile uint32_t INTEGRATOR;
+};
+
+/************************************************************************************
+ * Private Data
+ ************************************************************************************/
+
+/* Subscribers to the SoC frequency changes */
+static struct gap8_fll_notifier_s *_notifiers;
+
+/* Last synthesized settings, replaced round robin */
+static struct fll_setting_s {
+  uint32_t frequency;                   /* requested, 0 if unused */
+  uint32_t hz;                          /* achieved               */
+  uint16_t mult;
+  uint8_t div;
+} _cache[NR_CACHED];
+static uint32_t _cache_next;
+
+/* Retune in progress of each FLL, polled from the timer tick */
+static struct fll_retune_s {
+  uint32_t mult;                        /* 0 if none pending   */
+  struct gap8_completion_s *done;
+} _retune[2] GAP8_FC_TCDM_BSS;
+
+/************************************************************************************
+ * Private Functions
+ ************************************************************************************/
+
+static void _notify(bool post, uint32_t old_hz, uint32_t new_hz)
+{
+  struct gap8_fll_notifier_s *nb;
+
+  for (nb = _notifiers; nb; nb = nb->next)
+    {
+      if (!post && nb->pre_change)
+        {
+          nb->pre_change(old_hz, new_hz, nb->arg);
+        }
+      else if (post && nb->post_change)
+        {
+          nb->post_change(old_hz, new_hz, nb->arg);
+        }
+    }
+}
+
+/* Find the mult and div closest to `frequency` into `out`, or return false
+ * if out of range. FreqOut = Fref * mult / 2^(div-1): the larger div, the
+ * finer the step, as long as the DCO and the 16-bit mult keep up. The cache
+ * is shared with IRQ context: entries are copied in and out with IRQ
+ * disabled, never referenced. */
+
+static bool _synth(uint32_t frequency, struct fll_setting_s *out)
+{
+  struct fll_setting_s best = { 0 };
+  uint32_t best_err = UINT32_MAX;
+  uint32_t shift, mult, hz, err, i;
+  uint32_t flags;
+
+  if (frequency == 0)
+    {
+      return false;
+    }
+
+  flags = up_irq_save();
+  for (i = 0; i < NR_CACHED; i++)
+    {
+      if (_cache[i].frequency == frequency)
+        {
+          *out = _cache[i];
+          up_irq_restore(flags);
+          return true;
+        }
+    }
+  up_irq_restore(flags);
+
+  for (shift = 0; shift < MAX_DIV; shift++)
+    {
+      mult = (((uint64_t)frequency << shift) + FLL_REF_CLK / 2) >> LOG2_REFCLK;
+      if (mult == 0)
+        {
+          continue;
+        }
+      if (mult > FLL_CTRL_CONF1_MULTI_FACTOR_MASK ||
+          ((uint64_t)mult << LOG2_REFCLK) > DCO_MAX_HZ)
+        {
+          break;
+        }
+
+      hz = (uint32_t)(((uint64_t)mult << LOG2_REFCLK) >> shift);
+      err = hz > frequency ? hz - frequency : frequency - hz;
+      if (err <= best_err)
+        {
+          best_err = err;
+          best.hz = hz;
+          best.mult = mult;
+          best.div = shift + 1;
+        }
+    }
+
+  if (best.mult == 0)
+    {
+      return false;
+    }
+
+  best.frequency = frequency;
+  *out = best;
+
+  flags = up_irq_save();
+  _cache[_cache_next] = best;
+  _cache_next = (_cache_next + 1) % NR_CACHED;
+  up_irq_restore(flags);
+
+  return true;
+}
+
+/* Frequency out of an FLL, the status being its actual mult */
+
+static uint32_t _getfreq(struct fll_regs_s *fll)
+{
+  uint32_t div = READ_FLL_CTRL_CONF1_CLK_OUT_DIV(fll->CONF1);
+
+  /* FreqOut = Fref * mult/2^(div-1) */
+
+  return (FLL_REF_CLK * (fll->STATUS & 0xFFFF)) >> (div ? div - 1 : 0);
+}
+
+/* Program an FLL and leave it locking. Only the SoC one has notifiers. */
+
+static int _start(uint32_t id, uint32_t frequency,
+                  struct gap8_completion_s *done)
+{
+  struct fll_regs_s *fll = id == FLL_SOC ? SOC_FLL : CLUSTER_FLL;
+  struct fll_setting_s setting;
+  uint32_t old_hz;
+  uint32_t flags;
+
+  /* FreqOut = Fref * mult/2^(div-1)
+   * With 16-bit mult and 4-bit div */
+
+  if (!_synth(frequency, &setting))
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  if (_retune[id].mult)
+    {
+      up_irq_restore(flags);
+      return ERROR;
+    }
+
+  if (done)
+    {
+      gap8_completion_reinit(done);
+    }
+
+  old_hz = _getfreq(fll);
+  if (id == FLL_SOC)
+    {
+      _notify(false, old_hz, setting.hz);
+    }
+
+  /* Gain : 2-1 - 2-10 (0x2-0xB) 
+   * Return to close loop mode and give gain to feedback loop */
+
+  fll->CONF2 = FLL_CONF2(0x7);
+
+  /* Configure mult and div */
+
+  fll->CONF1 = FLL_CTRL_CONF1_MODE(1) |
+          FLL_CTRL_CONF1_MULTI_FACTOR(setting.mult) |
+          FLL_CTRL_CONF1_CLK_OUT_DIV(setting.div);
+
+  _retune[id].mult = setting.mult;
+  _retune[id].done = done;
+
+  /* The clock is heading for the new frequency from now on */
+
+  if (id == FLL_SOC)
+    {
+      _notify(true, old_hz, setting.hz);
+    }
+
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/* Finish the retune of an FLL if locked. Return true if none pending. */
+
+static bool _poll(uint32_t id)
+{
+  struct fll_regs_s *fll = id == FLL_SOC ? SOC_FLL : CLUSTER_FLL;
+  struct gap8_completion_s *done;
+  uint32_t diff;
+  uint32_t flags;
+
+  if (_retune[id].mult == 0)
+    {
+      return true;
+    }
+
+  /* Check FLL converge by compare status register with multiply factor.
+   * FLL_CONVERGE is not relied upon: it may still tell the previous lock. */
+
+  diff = __builtin_pulp_abs(fll->STATUS - _retune[id].mult);
+  if (diff > LOCK_TOLERANCE)
+    {
+      return false;
+    }
+
+  flags = up_irq_save();
+
+  done = _retune[id].done;
+  if (_retune[id].mult)
+    {
+      /* Locked: lower the loop gain to reduce jitter */
+
+      fll->CONF2 = FLL_CONF2(0xB);
+      _retune[id].mult = 0;
+      _retune[id].done = NULL;
+    }
+
+  up_irq_restore(flags);
+
+  if (done)
+    {
+      gap8_complete(done);
+    }
+
+  return true;
+}
+
 /************************************************************************************
  * Public Function
  ************************************************************************************/
 
 /****************************************************************************
- * Name: gap8_setfreq
+ * Name: gap8_fll_round_rate
  *
  * Description:
- *   Set frequency up to 250MHz. Input frequency counted by Hz.
+ *   Return the frequency closest to `frequency` Hz that the FLL can
+ *   output, or 0 if out of range.
  *
  ****************************************************************************/
 
-void gap8_setfreq(uint32_t frequency)
+uint32_t gap8_fll_round_rate(uint32_t frequency)
 {
-  uint32_t mult, mult_factor_diff;
+  struct fll_setting_s setting;
 
-  /* FreqOut = Fref * mult/2^(div-1)
-   * With 16-bit mult and 4-bit div
-   * div = 1 */
-  
-  mult = frequency >> LOG2_REFCLK;
+  return _synth(frequency, &setting) ? setting.hz : 0;
+}
 
-  /* Gain : 2-1 - 2-10 (0x2-0xB) 
-   * Return to close loop mode and give gain to feedback loop */
+/****************************************************************************
+ * Name: gap8_setfreq_start
+ *
+ * Description:
+ *   Start retuning to the closest achievable frequency to `frequency` Hz
+ *   and return at once. The notifiers are called with that frequency
+ *   before returning. `done`, if not NULL, is completed once the FLL has
+ *   locked. Return ERROR if out of range, or if a retune is still pending.
+ *
+ ****************************************************************************/
 
-  FLL_CTRL->SOC_CONF2 = FLL_CTRL_CONF2_LOOPGAIN(0x7) |
-          FLL_CTRL_CONF2_DEASSERT_CYCLES(0x10) |
-          FLL_CTRL_CONF2_ASSERT_CYCLES(0x10)   |
-          FLL_CTRL_CONF2_LOCK_TOLERANCE(0x100) |
-          FLL_CTRL_CONF2_CONF_CLK_SEL(0x0)     |
-          FLL_CTRL_CONF2_OPEN_LOOP(0x0)        |
-          FLL_CTRL_CONF2_DITHERING(0x1);
+int gap8_setfreq_start(uint32_t frequency, struct gap8_completion_s *done)
+{
+  return _start(FLL_SOC, frequency, done);
+}
 
-  /* Configure mult and div */
+/****************************************************************************
+ * Name: gap8_fll_poll
+ *
+ * Description:
+ *   Finish the pending retunes whose FLL has locked. Return true if none
+ *   is pending any more.
+ *
+ ****************************************************************************/
 
-  FLL_CTRL->SOC_CONF1 = FLL_CTRL_CONF1_MODE(1) |
-          FLL_CTRL_CONF1_MULTI_FACTOR(mult) |
-          FLL_CTRL_CONF1_CLK_OUT_DIV(1);
+bool gap8_fll_poll(void)
+{
+  bool soc = _poll(FLL_SOC);
+  bool cluster = _poll(FLL_CLUSTER);
 
-  /* Check FLL converge by compare status register with multiply factor */
+  return soc && cluster;
+}
 
-  do
+/****************************************************************************
+ * Name: gap8_setfreq
+ *
+ * Description:
+ *   Set frequency up to 250MHz. Input frequency counted by Hz. Blocks until
+ *   the FLL has locked, e.g. at boot. Return the frequency achieved, or 0
+ *   if out of range.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_setfreq(uint32_t frequency)
+{
+  while (!_poll(FLL_SOC))
+    ;
+
+  if (_start(FLL_SOC, frequency, NULL) != OK)
     {
-      mult_factor_diff = __builtin_pulp_abs(FLL_CTRL->SOC_FLL_STATUS - mult);
-    } while ( mult_factor_diff > 0x10 );
+      return 0;
+    }
+
+  while (!_poll(FLL_SOC))
+    ;
 
-  FLL_CTRL->SOC_CONF2 = FLL_CTRL_CONF2_LOOPGAIN(0xB) |
-      FLL_CTRL_CONF2_DEASSERT_CYCLES(0x10) |
-      FLL_CTRL_CONF2_ASSERT_CYCLES(0x10)   |
-      FLL_CTRL_CONF2_LOCK_TOLERANCE(0x100) |
-      FLL_CTRL_CONF2_CONF_CLK_SEL(0x0)     |
-      FLL_CTRL_CONF2_OPEN_LOOP(0x0)        |
-      FLL_CTRL_CONF2_DITHERING(0x1);
+  return gap8_fll_round_rate(frequency);
 }
 
 /****************************************************************************
@@ -85,7 +388,115 @@ void gap8_setfreq(uint32_t frequency)
 
 uint32_t gap8_getfreq(void)
 {
-  /* FreqOut = Fref * mult/2^(div-1), where div = 1 */
-  
-  return FLL_REF_CLK * (FLL_CTRL->SOC_FLL_STATUS & 0xFFFF);
+  return _getfreq(SOC_FLL);
+}
+
+/****************************************************************************
+ * Name: gap8_cluster_setfreq_start
+ *
+ * Description:
+ *   Same as gap8_setfreq_start(), for the cluster FLL.
+ *
+ ****************************************************************************/
+
+int gap8_cluster_setfreq_start(uint32_t frequency,
+                               struct gap8_completion_s *done)
+{
+  return _start(FLL_CLUSTER, frequency, done);
+}
+
+/****************************************************************************
+ * Name: gap8_cluster_setfreq
+ *
+ * Description:
+ *   Same as gap8_setfreq(), for the cluster FLL.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_cluster_setfreq(uint32_t frequency)
+{
+  while (!_poll(FLL_CLUSTER))
+    ;
+
+  if (_start(FLL_CLUSTER, frequency, NULL) != OK)
+    {
+      return 0;
+    }
+
+  while (!_poll(FLL_CLUSTER))
+    ;
+
+  return gap8_fll_round_rate(frequency);
+}
+
+/****************************************************************************
+ * Name: gap8_cluster_getfreq
+ *
+ * Description:
+ *   Get current cluster clock frequency in Hz.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_cluster_getfreq(void)
+{
+  return _getfreq(CLUSTER_FLL);
+}
+
+/****************************************************************************
+ * Name: gap8_fll_register_notifier
+ *
+ * Description:
+ *   Subscribe to the SoC frequency changes. Registering twice is harmless.
+ *
+ ****************************************************************************/
+
+void gap8_fll_register_notifier(struct gap8_fll_notifier_s *nb)
+{
+  struct gap8_fll_notifier_s *p;
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  for (p = _notifiers; p; p = p->next)
+    {
+      if (p == nb)
+        {
+          break;
+        }
+    }
+
+  if (p == NULL)
+    {
+      nb->next = _notifiers;
+      _notifiers = nb;
+    }
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_fll_unregister_notifier
+ *
+ * Description:
+ *   Stop notifying `nb`.
+ *
+ ****************************************************************************/
+
+void gap8_fll_unregister_notifier(struct gap8_fll_notifier_s *nb)
+{
+  struct gap8_fll_notifier_s **pp;
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  for (pp = &_notifiers; *pp; pp = &(*pp)->next)
+    {
+      if (*pp == nb)
+        {
+          *pp = nb->next;
+          break;
+        }
+    }
+
+  up_irq_restore(flags);
 }
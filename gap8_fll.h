@@ -1,7 +1,36 @@
 /************************************************************************************
  * GAP8 FLL clock generater
  *  FC can run up to 250MHz@1.2V, and 150MHz@1.0V. While the default voltage of PMU
- *  is 1.2V, it's okay to boost up without considering PMU.
+ *  is 1.2V, it's okay to boost up without considering PMU. gap8_dvfs.h pairs them
+ *  to run lower voltages.
+ * 
+ *  Drivers clocked by the FLL subscribe to frequency changes with a notifier. Its
+ *  pre-change callbacks run right before the FLL is given the new multiplier, and
+ *  its post-change callbacks right after, within the same IRQ-disabled section, so
+ *  that no ISR ever sees half of the dividers updated. The FLL then takes some us
+ *  to lock, during which the clock glides to the new frequency:
+ *
+ *    static struct gap8_fll_notifier_s nb = {
+ *      .post_change = my_recompute_dividers,
+ *    };
+ *
+ *    gap8_fll_register_notifier(&nb);
+ *
+ *  The callbacks must neither block nor change the frequency again.
+ *
+ *  The output is Fref * mult / 2^(div-1). Every div is tried for the closest match
+ *  to the requested frequency, within the DCO range; the last few results are
+ *  cached, so that switching back and forth costs no search.
+ *
+ *  The cluster has an FLL of its own, driven the same way by gap8_cluster_*, so
+ *  that it runs compute bursts at its own speed while the FC stays slow. The
+ *  cluster must be powered on, or its FLL never locks. No driver on the FC side
+ *  depends on it, so it has no notifiers.
+ *
+ *  gap8_setfreq() busy-waits for the lock, as needed at boot. At run time,
+ *  gap8_setfreq_start() returns at once and completes a gap8_sync completion on
+ *  lock. The lock is detected by gap8_fll_poll(), called from the timer tick, or
+ *  by hand in tickless mode.
  * 
  * Author: hhuysqt <1020988872@qq.com>
  * 
@@ -15,6 +44,25 @@
  ************************************************************************************/
 
 #include "GAP8.h"
+#include <stdbool.h>
+
+struct gap8_completion_s;
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+struct gap8_fll_notifier_s {
+  /* Either may be NULL. Called with IRQ disabled. */
+
+  void (*pre_change)(uint32_t old_hz, uint32_t new_hz, void *arg);
+  void (*post_change)(uint32_t old_hz, uint32_t new_hz, void *arg);
+  void *arg;
+
+  /* private */
+
+  struct gap8_fll_notifier_s *next;
+};
 
 /************************************************************************************
  * Public Function
@@ -24,11 +72,49 @@
  * Name: gap8_setfreq
  *
  * Description:
- *   Set frequency up to 250MHz. Input frequency in Hz.
+ *   Set frequency up to 250MHz. Input frequency in Hz. Blocks until the
+ *   FLL has locked. Return the frequency achieved, or 0 if out of range.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_setfreq(uint32_t frequency);
+
+/****************************************************************************
+ * Name: gap8_setfreq_start
+ *
+ * Description:
+ *   Start retuning to the closest achievable frequency to `frequency` Hz,
+ *   and return at once. The notifiers are called with that frequency
+ *   before returning. `done`, if not NULL, is completed once the FLL has
+ *   locked. Return ERROR if out of range or a retune is still pending.
+ *
+ ****************************************************************************/
+
+int gap8_setfreq_start(uint32_t frequency, struct gap8_completion_s *done);
+
+/****************************************************************************
+ * Name: gap8_fll_round_rate
+ *
+ * Description:
+ *   Return the frequency closest to `frequency` Hz that the FLL can
+ *   output, or 0 if out of range. Pick frequencies whose rounded value
+ *   divides evenly for the UART and timer.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_fll_round_rate(uint32_t frequency);
+
+/****************************************************************************
+ * Name: gap8_fll_poll
+ *
+ * Description:
+ *   Finish the pending retunes, SoC or cluster, whose FLL has locked, and
+ *   complete their completion. Return true if none is pending any more.
+ *   Called from the timer tick.
  *
  ****************************************************************************/
 
-void gap8_setfreq(uint32_t frequency);
+bool gap8_fll_poll(void);
 
 /****************************************************************************
  * Name: gap8_getfreq
@@ -40,4 +126,55 @@ void gap8_setfreq(uint32_t frequency);
 
 uint32_t gap8_getfreq(void);
 
-#endif
\ No newline at end of file
+/****************************************************************************
+ * Name: gap8_cluster_setfreq
+ *
+ * Description:
+ *   Same as gap8_setfreq(), for the cluster FLL.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_cluster_setfreq(uint32_t frequency);
+
+/****************************************************************************
+ * Name: gap8_cluster_setfreq_start
+ *
+ * Description:
+ *   Same as gap8_setfreq_start(), for the cluster FLL.
+ *
+ ****************************************************************************/
+
+int gap8_cluster_setfreq_start(uint32_t frequency,
+                               struct gap8_completion_s *done);
+
+/****************************************************************************
+ * Name: gap8_cluster_getfreq
+ *
+ * Description:
+ *   Get current cluster clock frequency in Hz.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_cluster_getfreq(void);
+
+/****************************************************************************
+ * Name: gap8_fll_register_notifier
+ *
+ * Description:
+ *   Subscribe to the SoC frequency changes. Registering twice is harmless.
+ *
+ ****************************************************************************/
+
+void gap8_fll_register_notifier(struct gap8_fll_notifier_s *nb);
+
+/****************************************************************************
+ * Name: gap8_fll_unregister_notifier
+ *
+ * Description:
+ *   Stop notifying `nb`.
+ *
+ ****************************************************************************/
+
+void gap8_fll_unregister_notifier(struct gap8_fll_notifier_s *nb);
+
+#endif
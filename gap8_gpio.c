@@ -8,83 +8,210 @@
  ************************************************************************************/
 
 #include "gap8_gpio.h"
+#include "gap8_section.h"
+#include <stddef.h>
 
 /************************************************************************************
- * Name: gap8_configpin
+ * Pre-processor Definitions
+ ************************************************************************************/
+
+#define NELEM(a)      (sizeof(a) / sizeof((a)[0]))
+
+/************************************************************************************
+ * Private Types
+ ************************************************************************************/
+
+/* Bits to change in a register, and their new value */
+
+struct pinmux_reg_s {
+  uint32_t mask;
+  uint32_t val;
+};
+
+/* Every register touched by pin configuration */
+
+struct pinmux_s {
+  struct pinmux_reg_s padcfg[NELEM(PORTA->PADCFG)];
+  struct pinmux_reg_s padfun[NELEM(PORTA->PADFUN)];
+  struct pinmux_reg_s gpio_padcfg[NELEM(GPIOA->PADCFG)];
+  struct pinmux_reg_s gpio_en;
+  struct pinmux_reg_s gpio_dir;
+};
+
+/************************************************************************************
+ * Private Data
+ ************************************************************************************/
+
+/* Looked up on every GPIO event, keep it in FC TCDM */
+static struct {
+  void (*handler)(uint32_t gpio, void *arg);
+  void *arg;
+} _gpio_irq[32] GAP8_FC_TCDM_BSS;
+
+/************************************************************************************
+ * Private Functions
+ ************************************************************************************/
+
+static inline void _set_field(struct pinmux_reg_s *reg, uint32_t mask,
+                              uint32_t val)
+{
+  reg->mask |= mask;
+  reg->val = (reg->val & ~mask) | (val & mask);
+}
+
+/* Read-modify-write a register, once, if there is anything to change */
+
+static inline void _apply(volatile uint32_t *hw, const struct pinmux_reg_s *reg)
+{
+  if (reg->mask)
+    {
+      *hw = (*hw & ~reg->mask) | reg->val;
+    }
+}
+
+/************************************************************************************
+ * Public Functions
+ ************************************************************************************/
+
+/************************************************************************************
+ * Name: gap8_configpins
  *
  * Description:
- *   Configure a pin based on bit-encoded description of the pin.
- * 
- * GPIO software abstraction: bitmap configuration of pins
- * 
- * |31 18|   17  |     16     |  15 |14   10|9     8|7      0|
- * | --- | drive | pull-up/OD | I/O | GPIOn |  alt  | pinnum |
- * | --- | 1-bit |   1-bit    | 1-b | 5-bit | 2-bit |  8-bit |
+ *   Configure `n` pins from a table of bit-encoded descriptions, see
+ *   gap8_configpin(). The final value of every register is computed first,
+ *   then each register touched is written once: pad configurations first,
+ *   GPIO setup next, and pad functions last, as gap8_configpin() does.
+ *   A later entry for the same pin wins.
  *
  * Returned Value:
  *   OK on success
- *   ERROR on invalid pin.
+ *   ERROR on invalid pin, with no pin configured.
  *
  ************************************************************************************/
 
-int gap8_configpin(uint32_t cfgset)
+int gap8_configpins(const uint32_t *cfgset, uint32_t n)
 {
-  uint32_t pinnum = cfgset & 0xff;
-  uint32_t altfunc = (cfgset >> 8) & 0x3;
-  uint32_t pin_dr_pu = (cfgset >> 16) & 0x3;
-  uint32_t port_cfg_reg, pin_alt_reg;
-  int shiftcnt;
+  struct pinmux_s mux = { 0 };
+  uint32_t flags, i;
+
+  for (i = 0; i < n; i++)
+    {
+      uint32_t pinnum = cfgset[i] & 0xff;
+      uint32_t altfunc = (cfgset[i] >> 8) & 0x3;
+      uint32_t pin_dr_pu = (cfgset[i] >> 16) & 0x3;
+      int shiftcnt;
+
+      if (pinnum > MAX_PIN_NUM)
+        {
+          return ERROR;
+        }
+
+      /* Drive strength and pulling. GPIO and non-GPIO uses different
+       * register sets, and all the GPIO functions are mapped to ALT-1. */
+
+      shiftcnt = (pinnum & 0x3) << 3;
+      _set_field(&mux.padcfg[pinnum >> 2], 0x3 << shiftcnt,
+                 pin_dr_pu << shiftcnt);
+
+      if (altfunc == 1)
+        {
+          uint32_t gpio_n = (cfgset[i] >> 10) & 0x1f;
+          uint32_t gpio_dir = (cfgset[i] >> 15) & 0x1;
+
+          _set_field(&mux.gpio_en, 1L << gpio_n, 1L << gpio_n);
+
+          shiftcnt = (gpio_n & 0x3) << 3;
+          _set_field(&mux.gpio_padcfg[gpio_n >> 2], 0x3 << shiftcnt,
+                     pin_dr_pu << shiftcnt);
+
+          _set_field(&mux.gpio_dir, 1L << gpio_n, gpio_dir << gpio_n);
+        }
+
+      shiftcnt = (pinnum & 0xf) << 1;
+      _set_field(&mux.padfun[pinnum >> 4], 0x3 << shiftcnt,
+                 altfunc << shiftcnt);
+    }
+
+  flags = up_irq_save();
 
-  if (pinnum > MAX_PIN_NUM)
+  for (i = 0; i < NELEM(mux.padcfg); i++)
     {
-      return ERROR;
+      _apply(&PORTA->PADCFG[i], &mux.padcfg[i]);
     }
 
-  /* Set pin drive strength (or pin speed in other words) and pulling
-   * If it's a GPIO, set input or output.
-   *
-   * Note that GPIO and non-GPIO uses different register sets...
-   * And all the GPIO functions are mapped to ALT-1, and ALT-1 contains
-   * only GPIO functions...
-   **/
-
-  port_cfg_reg = PORTA->PADCFG[pinnum >> 2];
-  shiftcnt = (pinnum & 0x3) << 3;
-  port_cfg_reg &=     ~(0x3 << shiftcnt);
-  port_cfg_reg |= pin_dr_pu << shiftcnt;
-  PORTA->PADCFG[pinnum >> 2] = port_cfg_reg;
-
-  if (altfunc == 1)
+  _apply(&GPIOA->EN, &mux.gpio_en);
+  for (i = 0; i < NELEM(mux.gpio_padcfg); i++)
     {
-      uint32_t gpio_n = (cfgset >> 10) & 0x1f;
-      uint32_t gpio_dir = (cfgset >> 15) & 0x1;
-      uint32_t tmp;
+      _apply(&GPIOA->PADCFG[i], &mux.gpio_padcfg[i]);
+    }
+  _apply(&GPIOA->DIR, &mux.gpio_dir);
 
-      /* It must be a GPIO */
+  for (i = 0; i < NELEM(mux.padfun); i++)
+    {
+      _apply(&PORTA->PADFUN[i], &mux.padfun[i]);
+    }
 
-      GPIOA->EN |= (1L << gpio_n);
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/************************************************************************************
+ * Name: gap8_pinimage_apply
+ *
+ * Description:
+ *   Write the register words of a GAP8_PINIMAGE(): pad configurations
+ *   first, GPIO setup next, and pad functions last.
+ *
+ ************************************************************************************/
+
+void gap8_pinimage_apply(const struct gap8_pinimage_s *image)
+{
+  uint32_t flags, i;
+
+  flags = up_irq_save();
+
+  for (i = 0; i < NELEM(image->padcfg); i++)
+    {
+      PORTA->PADCFG[i] = image->padcfg[i];
+    }
 
-      tmp = GPIOA->PADCFG[gpio_n >> 2];
-      shiftcnt = (gpio_n & 0x3) << 3;
-      tmp &=     ~(0x3 << shiftcnt);
-      tmp |= pin_dr_pu << shiftcnt;
-      GPIOA->PADCFG[gpio_n >> 2] = tmp;
+  GPIOA->EN = image->gpio_en;
+  for (i = 0; i < NELEM(image->gpio_padcfg); i++)
+    {
+      GPIOA->PADCFG[i] = image->gpio_padcfg[i];
+    }
+  GPIOA->DIR = image->gpio_dir;
 
-      tmp = GPIOA->DIR;
-      tmp &= ~(1L << gpio_n);
-      tmp |= gpio_dir << gpio_n;
-      GPIOA->DIR = tmp;
+  for (i = 0; i < NELEM(image->padfun); i++)
+    {
+      PORTA->PADFUN[i] = image->padfun[i];
     }
 
-  /* Set pin alternative function */
+  up_irq_restore(flags);
+}
 
-  pin_alt_reg = PORTA->PADFUN[pinnum >> 4];
-  shiftcnt = (pinnum & 0xf) << 1;
-  pin_alt_reg &=   ~(0x3 << shiftcnt);
-  pin_alt_reg |= altfunc << shiftcnt;
-  PORTA->PADFUN[pinnum >> 4] = pin_alt_reg;
+/************************************************************************************
+ * Name: gap8_configpin
+ *
+ * Description:
+ *   Configure a pin based on bit-encoded description of the pin.
+ * 
+ * GPIO software abstraction: bitmap configuration of pins
+ * 
+ * |31 18|   17  |     16     |  15 |14   10|9     8|7      0|
+ * | --- | drive | pull-up/OD | I/O | GPIOn |  alt  | pinnum |
+ * | --- | 1-bit |   1-bit    | 1-b | 5-bit | 2-bit |  8-bit |
+ *
+ * Returned Value:
+ *   OK on success
+ *   ERROR on invalid pin.
+ *
+ ************************************************************************************/
 
-  return OK;
+int gap8_configpin(uint32_t cfgset)
+{
+  return gap8_configpins(&cfgset, 1);
 }
 
 /************************************************************************************
@@ -103,15 +230,9 @@ int gap8_configpin(uint32_t cfgset)
 
 void gap8_gpiowrite(uint32_t pinset, bool value)
 {
-  uint32_t gpio_n = (pinset >> 10) & 0x1f;
-  if (value)
-    {
-      GPIOA->OUT |= (1L << gpio_n);
-    }
-  else
-    {
-      GPIOA->OUT &= ~(1L << gpio_n);
-    }
+  uint32_t mask = GAP8_GPIO_MASK(pinset);
+
+  gap8_gpio_port_write(mask, value ? mask : 0);
 }
 
 /************************************************************************************
@@ -130,8 +251,7 @@ void gap8_gpiowrite(uint32_t pinset, bool value)
 
 bool gap8_gpioread(uint32_t pinset)
 {
-  uint32_t gpio_n = (pinset >> 10) & 0x1f;
-  return (GPIOA->IN >> gpio_n) & 0x1;
+  return gap8_gpio_port_read(GAP8_GPIO_MASK(pinset)) != 0;
 }
 
 /************************************************************************************
@@ -151,8 +271,10 @@ bool gap8_gpioread(uint32_t pinset)
 void gap8_gpioirqset(uint32_t pinset, bool enable)
 {
   uint32_t gpio_n = (pinset >> 10) & 0x1f;
-  uint32_t int_type = (pinset >> 18) * 0x3;
-  uint32_t tmp, shitfcnt;
+  uint32_t int_type = (pinset >> 18) & 0x3;
+  uint32_t tmp, shitfcnt, flags;
+
+  flags = up_irq_save();
 
   if (enable)
     {
@@ -163,6 +285,75 @@ void gap8_gpioirqset(uint32_t pinset, bool enable)
       GPIOA->INTCFG[gpio_n >> 4] = tmp;
       
       GPIOA->INTEN |= (1L << gpio_n);
+      up_enable_event(GAP8_EVENT_GPIO);
     }
+  else
+    {
+      GPIOA->INTEN &= ~(1L << gpio_n);
+      if (GPIOA->INTEN == 0)
+        {
+          up_disable_event(GAP8_EVENT_GPIO);
+        }
+    }
+
+  up_irq_restore(flags);
+}
+
+/************************************************************************************
+ * Name: gap8_gpio_attach
+ *
+ * Description:
+ *   Call `handler` from IRQ on the edges of the pinset, and enable its
+ *   interrupt. A NULL handler disables it.
+ *
+ ************************************************************************************/
+
+void gap8_gpio_attach(uint32_t pinset,
+                      void (*handler)(uint32_t gpio, void *arg), void *arg)
+{
+  uint32_t gpio_n = (pinset >> 10) & 0x1f;
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (handler == NULL)
+    {
+      gap8_gpioirqset(pinset, false);
+    }
+
+  _gpio_irq[gpio_n].handler = handler;
+  _gpio_irq[gpio_n].arg = arg;
+
+  if (handler != NULL)
+    {
+      gap8_gpioirqset(pinset, true);
+    }
+
+  up_irq_restore(flags);
 }
 
+/************************************************************************************
+ * Name: gap8_gpio_doirq
+ *
+ * Description:
+ *   GPIO event handler. Reading INTSTATUS clears it, so read it once and
+ *   call the handler of each pin set in it, lowest GPIO first.
+ *
+ ************************************************************************************/
+
+void gap8_gpio_doirq(void)
+{
+  uint32_t status = GPIOA->INTSTATUS;
+  uint32_t gpio_n;
+
+  while (status)
+    {
+      gpio_n = __builtin_ctz(status);
+      status &= status - 1;
+
+      if (_gpio_irq[gpio_n].handler)
+        {
+          _gpio_irq[gpio_n].handler(gpio_n, _gpio_irq[gpio_n].arg);
+        }
+    }
+}
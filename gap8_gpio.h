@@ -2,6 +2,19 @@
  * PIN driver for GAP8
  *  GAP8 has only 1 port. Each pin could be configured to GPIO or alternative
  *  functions.
+ *
+ *  The port has no set or clear register, so every change of GPIOA->OUT is a
+ *  read-modify-write. The port operations below change any set of pins with a
+ *  single one, with IRQ disabled around it, so that they do not race with an
+ *  ISR driving other pins of the port. Masks are by GPIO number, see
+ *  GAP8_GPIO_MASK():
+ *
+ *    #define BUS_MASK  (0xffL << 4)          GPIOA4..GPIOA11
+ *    gap8_gpio_port_write(BUS_MASK, byte << 4);
+ *    gap8_gpio_port_toggle(GAP8_GPIO_MASK(GAP8_PIN_B11_GPIOA17));
+ *
+ *  Pin-change interrupts all come as one SoC event. gap8_gpio_doirq() reads the
+ *  pending pins once and calls the handler given to gap8_gpio_attach() for each.
  * 
  * Author: hhuysqt <1020988872@qq.com>
  * 
@@ -14,6 +27,7 @@
  ************************************************************************************/
 
 #include "GAP8.h"
+#include "gap8_interrupt.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -220,6 +234,75 @@
 #define GAP8_PIN_A26_I2S0_WS      ((0L << 8) | 46)
 #define GAP8_PIN_B23_I2S0_SDI     ((0L << 8) | 47)
 
+/* Port mask of the GPIO of a pinset */
+#define GAP8_GPIO_MASK(pinset)    (1L << (((pinset) >> 10) & 0x1f))
+
+/*
+ * Register words of a whole pin table, computed by the compiler, see
+ * gap8_pinimage_apply(). The table is a list macro taking a field macro
+ * and a register index, and passing both along with each pinset:
+ *
+ *    #define BOARD_PINS(F, i) \
+ *      F(i, GAP8_PIN_A7_UART_TX) \
+ *      F(i, GAP8_PIN_B6_UART_RX) \
+ *      F(i, GAP8_PIN_B11_GPIOA17 | GAP8_GPIO_OUTPUT)
+ *
+ *    static const struct gap8_pinimage_s board_pins = GAP8_PINIMAGE(BOARD_PINS);
+ **/
+#define GAP8_PI_PIN(cfg)          ((cfg) & 0xff)
+#define GAP8_PI_ALT(cfg)          (((cfg) >> 8) & 0x3)
+#define GAP8_PI_GPIO(cfg)         (((cfg) >> 10) & 0x1f)
+#define GAP8_PI_DRPU(cfg)         (((cfg) >> 16) & 0x3)
+#define GAP8_PI_IS_GPIO(cfg)      (GAP8_PI_ALT(cfg) == 1)
+
+#define GAP8_PI_PADFUN(i, cfg) \
+  | ((GAP8_PI_PIN(cfg) >> 4) == (i) ? \
+     GAP8_PI_ALT(cfg) << ((GAP8_PI_PIN(cfg) & 0xf) << 1) : 0)
+#define GAP8_PI_PADCFG(i, cfg) \
+  | ((GAP8_PI_PIN(cfg) >> 2) == (i) ? \
+     GAP8_PI_DRPU(cfg) << ((GAP8_PI_PIN(cfg) & 0x3) << 3) : 0)
+#define GAP8_PI_GPIO_PADCFG(i, cfg) \
+  | (GAP8_PI_IS_GPIO(cfg) && (GAP8_PI_GPIO(cfg) >> 2) == (i) ? \
+     GAP8_PI_DRPU(cfg) << ((GAP8_PI_GPIO(cfg) & 0x3) << 3) : 0)
+#define GAP8_PI_GPIO_EN(i, cfg) \
+  | (GAP8_PI_IS_GPIO(cfg) ? 1UL << GAP8_PI_GPIO(cfg) : 0)
+#define GAP8_PI_GPIO_DIR(i, cfg) \
+  | (GAP8_PI_IS_GPIO(cfg) ? (((cfg) >> 15) & 0x1UL) << GAP8_PI_GPIO(cfg) : 0)
+
+#define GAP8_PINIMAGE(list) { \
+  .padfun = { \
+    0 list(GAP8_PI_PADFUN, 0), 0 list(GAP8_PI_PADFUN, 1), \
+    0 list(GAP8_PI_PADFUN, 2), 0 list(GAP8_PI_PADFUN, 3) }, \
+  .padcfg = { \
+    0 list(GAP8_PI_PADCFG, 0), 0 list(GAP8_PI_PADCFG, 1), \
+    0 list(GAP8_PI_PADCFG, 2), 0 list(GAP8_PI_PADCFG, 3), \
+    0 list(GAP8_PI_PADCFG, 4), 0 list(GAP8_PI_PADCFG, 5), \
+    0 list(GAP8_PI_PADCFG, 6), 0 list(GAP8_PI_PADCFG, 7), \
+    0 list(GAP8_PI_PADCFG, 8), 0 list(GAP8_PI_PADCFG, 9), \
+    0 list(GAP8_PI_PADCFG, 10), 0 list(GAP8_PI_PADCFG, 11) }, \
+  .gpio_padcfg = { \
+    0 list(GAP8_PI_GPIO_PADCFG, 0), 0 list(GAP8_PI_GPIO_PADCFG, 1), \
+    0 list(GAP8_PI_GPIO_PADCFG, 2), 0 list(GAP8_PI_GPIO_PADCFG, 3), \
+    0 list(GAP8_PI_GPIO_PADCFG, 4), 0 list(GAP8_PI_GPIO_PADCFG, 5), \
+    0 list(GAP8_PI_GPIO_PADCFG, 6), 0 list(GAP8_PI_GPIO_PADCFG, 7) }, \
+  .gpio_en = 0 list(GAP8_PI_GPIO_EN, 0), \
+  .gpio_dir = 0 list(GAP8_PI_GPIO_DIR, 0), \
+}
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+/* Final register words of every pin, MAX_PIN_NUM + 1 of them */
+
+struct gap8_pinimage_s {
+  uint32_t padfun[4];
+  uint32_t padcfg[12];
+  uint32_t gpio_padcfg[8];
+  uint32_t gpio_en;
+  uint32_t gpio_dir;
+};
+
 
 /************************************************************************************
  * Public Function Prototypes
@@ -229,16 +312,57 @@
  * Name: gap8_configpin
  *
  * Description:
- *   Configure a pin based on bit-encoded description of the pin.
+ *   Configure a pin based on bit-encoded description of the pin. Other
+ *   pins are left as they are.
  *
  * Returned Value:
  *   OK on success
- *   ERROR on invalid port, or when pin is locked as ALT function.
+ *   ERROR on invalid pin.
  *
  ************************************************************************************/
 
 int gap8_configpin(uint32_t cfgset);
 
+/************************************************************************************
+ * Name: gap8_configpins
+ *
+ * Description:
+ *   Configure `n` pins from a table of bit-encoded descriptions, writing
+ *   each register involved once. Meant for the board pin table at boot:
+ *
+ *    static const uint32_t board_pins[] = {
+ *      GAP8_PIN_A7_UART_TX,
+ *      GAP8_PIN_B6_UART_RX,
+ *      GAP8_PIN_B11_GPIOA17 | GAP8_GPIO_OUTPUT,
+ *      ...
+ *    };
+ *
+ *    gap8_configpins(board_pins, sizeof(board_pins) / sizeof(board_pins[0]));
+ *
+ *   Pins not in the table are left as they are. For the whole board table,
+ *   gap8_pinimage_apply() does without the decoding.
+ *
+ * Returned Value:
+ *   OK on success
+ *   ERROR on invalid pin, with no pin configured.
+ *
+ ************************************************************************************/
+
+int gap8_configpins(const uint32_t *cfgset, uint32_t n);
+
+/************************************************************************************
+ * Name: gap8_pinimage_apply
+ *
+ * Description:
+ *   Write the register words of a GAP8_PINIMAGE(), with plain stores in the
+ *   order of gap8_configpins(). It sets every pin: those not in the table
+ *   go back to their reset function, and GPIOs not in the table are
+ *   disabled. Invalid pinsets are not checked.
+ *
+ ************************************************************************************/
+
+void gap8_pinimage_apply(const struct gap8_pinimage_s *image);
+
 /************************************************************************************
  * Name: gap8_gpiowrite
  *
@@ -269,5 +393,110 @@ bool gap8_gpioread(uint32_t pinset);
 
 void gap8_gpioirqset(uint32_t pinset, bool enable);
 
+/************************************************************************************
+ * Name: gap8_gpio_attach
+ *
+ * Description:
+ *   Call `handler` from IRQ on the edges of the pinset, given with its
+ *   GAP8_GPIO_INT_xxx type, and enable its interrupt. A NULL handler
+ *   disables it.
+ *
+ ************************************************************************************/
+
+void gap8_gpio_attach(uint32_t pinset,
+                      void (*handler)(uint32_t gpio, void *arg), void *arg);
+
+/************************************************************************************
+ * Name: gap8_gpio_doirq
+ *
+ * Description:
+ *   GPIO event handler, called by gap8_dispatch_irq(). Costs one read of
+ *   INTSTATUS, and one step per pin pending.
+ *
+ ************************************************************************************/
+
+void gap8_gpio_doirq(void);
+
+/************************************************************************************
+ * Inline Functions
+ ************************************************************************************/
+
+/************************************************************************************
+ * Name: gap8_gpio_port_write
+ *
+ * Description:
+ *   Drive the GPIOs of `mask` to the matching bits of `value`, in one write
+ *   of the port. Other GPIOs keep their level.
+ *
+ ************************************************************************************/
+
+static inline void gap8_gpio_port_write(uint32_t mask, uint32_t value)
+{
+  uint32_t flags = up_irq_save();
+
+  GPIOA->OUT = (GPIOA->OUT & ~mask) | (value & mask);
+  up_irq_restore(flags);
+}
+
+/************************************************************************************
+ * Name: gap8_gpio_port_set
+ *
+ * Description:
+ *   Drive the GPIOs of `mask` high, in one write of the port.
+ *
+ ************************************************************************************/
+
+static inline void gap8_gpio_port_set(uint32_t mask)
+{
+  uint32_t flags = up_irq_save();
+
+  GPIOA->OUT |= mask;
+  up_irq_restore(flags);
+}
+
+/************************************************************************************
+ * Name: gap8_gpio_port_clear
+ *
+ * Description:
+ *   Drive the GPIOs of `mask` low, in one write of the port.
+ *
+ ************************************************************************************/
+
+static inline void gap8_gpio_port_clear(uint32_t mask)
+{
+  uint32_t flags = up_irq_save();
+
+  GPIOA->OUT &= ~mask;
+  up_irq_restore(flags);
+}
+
+/************************************************************************************
+ * Name: gap8_gpio_port_toggle
+ *
+ * Description:
+ *   Invert the GPIOs of `mask`, in one write of the port.
+ *
+ ************************************************************************************/
+
+static inline void gap8_gpio_port_toggle(uint32_t mask)
+{
+  uint32_t flags = up_irq_save();
+
+  GPIOA->OUT ^= mask;
+  up_irq_restore(flags);
+}
+
+/************************************************************************************
+ * Name: gap8_gpio_port_read
+ *
+ * Description:
+ *   Return the input levels of the GPIOs of `mask`, sampled at once.
+ *
+ ************************************************************************************/
+
+static inline uint32_t gap8_gpio_port_read(uint32_t mask)
+{
+  return GPIOA->IN & mask;
+}
 
 #endif
@@ -0,0 +1,186 @@
+/************************************************************************************
+ * GAP8 FC instruction cache
+ *  Control through the SCBC block, and miss profiling with the core performance
+ *  counter.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_icache.h"
+#include "gap8_perf.h"
+#include "gap8_section.h"
+#include <stdio.h>
+#include <string.h>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const uint32_t _prof_events[GAP8_ICACHE_PROF_NR] = {
+  GAP8_PERF_CYCLES, GAP8_PERF_INSTR, GAP8_PERF_IMISS,
+};
+
+/* uDMA cannot read FC TCDM, so format the output in L2 */
+static char _linebuf[128] GAP8_L2_DMA;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Drop the prefetched instructions, they may come from the stale lines */
+
+static inline void _sync_fetch(void)
+{
+  asm volatile ("fence.i" : : : "memory");
+}
+
+static inline uint32_t _average(uint64_t count, uint32_t runs)
+{
+  return runs ? (uint32_t)(count / runs) : 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_icache_enable
+ *
+ * Description:
+ *   Enable or disable the FC icache.
+ *
+ ****************************************************************************/
+
+void gap8_icache_enable(bool enable)
+{
+  SCBC->ICACHE_ENABLE = enable ? 0xFFFFFFFF : 0;
+  _sync_fetch();
+}
+
+/****************************************************************************
+ * Name: gap8_icache_is_enabled
+ *
+ * Description:
+ *   Return true if the FC icache is enabled.
+ *
+ ****************************************************************************/
+
+bool gap8_icache_is_enabled(void)
+{
+  return SCBC->ICACHE_ENABLE != 0;
+}
+
+/****************************************************************************
+ * Name: gap8_icache_flush
+ *
+ * Description:
+ *   Invalidate the whole FC icache.
+ *
+ ****************************************************************************/
+
+void gap8_icache_flush(void)
+{
+  SCBC->ICACHE_FLUSH = 0xFFFFFFFF;
+  _sync_fetch();
+}
+
+/****************************************************************************
+ * Name: gap8_icache_flush_range
+ *
+ * Description:
+ *   Invalidate the lines holding [addr, addr + size). Large ranges flush the
+ *   whole cache, which is faster than going line by line.
+ *
+ ****************************************************************************/
+
+void gap8_icache_flush_range(const void *addr, uint32_t size)
+{
+  uint32_t line = (uint32_t)addr & ~(GAP8_ICACHE_LINE_SIZE - 1);
+  uint32_t end = (uint32_t)addr + size;
+
+  if (size == 0)
+    {
+      return;
+    }
+
+  if ((end - line) / GAP8_ICACHE_LINE_SIZE > GAP8_ICACHE_SEL_FLUSH_MAX)
+    {
+      gap8_icache_flush();
+      return;
+    }
+
+  for (; line < end; line += GAP8_ICACHE_LINE_SIZE)
+    {
+      SCBC->ICACHE_LX_SEL_FLUSH = line;
+    }
+
+  _sync_fetch();
+}
+
+/****************************************************************************
+ * Name: gap8_icache_prof_begin
+ *
+ * Description:
+ *   Start a profiled run of a region. Not reentrant: profiled regions must
+ *   not nest, nor run in ISRs.
+ *
+ ****************************************************************************/
+
+void gap8_icache_prof_begin(struct gap8_icache_prof_s *prof)
+{
+  prof->pcer = gap8_perf_events();
+  gap8_perf_select(_prof_events[prof->next]);
+  prof->start = gap8_perf_read();
+}
+
+/****************************************************************************
+ * Name: gap8_icache_prof_end
+ *
+ * Description:
+ *   End a profiled run of a region, and account the sampled event.
+ *
+ ****************************************************************************/
+
+void gap8_icache_prof_end(struct gap8_icache_prof_s *prof)
+{
+  uint32_t count = gap8_perf_read() - prof->start;
+
+  gap8_perf_select(prof->pcer);
+
+  prof->count[prof->next] += count;
+  prof->runs[prof->next]++;
+  prof->next = (prof->next + 1) % GAP8_ICACHE_PROF_NR;
+}
+
+/****************************************************************************
+ * Name: gap8_icache_prof_dump
+ *
+ * Description:
+ *   Print the average cycles, instructions and fetch stall cycles per run,
+ *   and the stall ratio in per mille of cycles, on `uart`.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_icache_prof_dump(struct gap8_uart_t *uart, const char *name,
+                           const struct gap8_icache_prof_s *prof)
+{
+  uint32_t cycles = _average(prof->count[GAP8_ICACHE_PROF_CYCLES],
+                             prof->runs[GAP8_ICACHE_PROF_CYCLES]);
+  uint32_t instr = _average(prof->count[GAP8_ICACHE_PROF_INSTR],
+                            prof->runs[GAP8_ICACHE_PROF_INSTR]);
+  uint32_t imiss = _average(prof->count[GAP8_ICACHE_PROF_IMISS],
+                            prof->runs[GAP8_ICACHE_PROF_IMISS]);
+
+  sprintf(_linebuf, "%s: runs=%lu cyc=%lu instr=%lu imiss=%lu (%lu/1000)\r\n",
+          name,
+          (unsigned long)(prof->runs[0] + prof->runs[1] + prof->runs[2]),
+          (unsigned long)cycles, (unsigned long)instr, (unsigned long)imiss,
+          (unsigned long)(cycles ? (uint64_t)imiss * 1000 / cycles : 0));
+  gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+}
@@ -0,0 +1,143 @@
+/************************************************************************************
+ * GAP8 FC instruction cache
+ *  FC executes from L2 through its private icache, controlled by the SCBC block.
+ *  Flush the cache, or the range concerned, after writing code at runtime (loading
+ *  an overlay, patching a vector...), before jumping to it.
+ *
+ *  Miss profiling: the core has a single performance counter, counting the events
+ *  enabled in PCER. A profiled region therefore samples one event per run, cycling
+ *  through cycles, retired instructions and fetch stall cycles (IMISS), and the
+ *  rates are averaged over the runs. Wrap a region that runs many times:
+ *
+ *    static struct gap8_icache_prof_s prof;
+ *    ...
+ *    gap8_icache_prof_begin(&prof);
+ *    hot_loop();
+ *    gap8_icache_prof_end(&prof);
+ *
+ *  The counter keeps running, only the counted event changes inside the region.
+ *  Cycle stamps taken across a profiled region (IRQ trace) are off meanwhile.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_ICACHE_H
+#define GAP8_ICACHE_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include "gap8_uart.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/************************************************************************************
+ * Pre-Processor Declarations
+ ************************************************************************************/
+
+/* Cache line size in bytes */
+#define GAP8_ICACHE_LINE_SIZE     16
+
+/* Range flushes above this many lines flush the whole cache instead */
+#define GAP8_ICACHE_SEL_FLUSH_MAX 64
+
+/* Events sampled by the profiler, in turn */
+#define GAP8_ICACHE_PROF_CYCLES   0
+#define GAP8_ICACHE_PROF_INSTR    1
+#define GAP8_ICACHE_PROF_IMISS    2
+#define GAP8_ICACHE_PROF_NR       3
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+struct gap8_icache_prof_s {
+  uint32_t runs[GAP8_ICACHE_PROF_NR];     /* runs that sampled each event */
+  uint64_t count[GAP8_ICACHE_PROF_NR];    /* accumulated counts           */
+  uint32_t next;                          /* event sampled by next run    */
+  uint32_t start;                         /* counter at begin             */
+  uint32_t pcer;                          /* PCER saved at begin          */
+};
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_icache_enable
+ *
+ * Description:
+ *   Enable or disable the FC icache.
+ *
+ ****************************************************************************/
+
+void gap8_icache_enable(bool enable);
+
+/****************************************************************************
+ * Name: gap8_icache_is_enabled
+ *
+ * Description:
+ *   Return true if the FC icache is enabled.
+ *
+ ****************************************************************************/
+
+bool gap8_icache_is_enabled(void);
+
+/****************************************************************************
+ * Name: gap8_icache_flush
+ *
+ * Description:
+ *   Invalidate the whole FC icache.
+ *
+ ****************************************************************************/
+
+void gap8_icache_flush(void);
+
+/****************************************************************************
+ * Name: gap8_icache_flush_range
+ *
+ * Description:
+ *   Invalidate the lines holding [addr, addr + size). Large ranges flush the
+ *   whole cache, which is faster than going line by line.
+ *
+ ****************************************************************************/
+
+void gap8_icache_flush_range(const void *addr, uint32_t size);
+
+/****************************************************************************
+ * Name: gap8_icache_prof_begin
+ *
+ * Description:
+ *   Start a profiled run of a region. Not reentrant: profiled regions must
+ *   not nest, nor run in ISRs.
+ *
+ ****************************************************************************/
+
+void gap8_icache_prof_begin(struct gap8_icache_prof_s *prof);
+
+/****************************************************************************
+ * Name: gap8_icache_prof_end
+ *
+ * Description:
+ *   End a profiled run of a region, and account the sampled event.
+ *
+ ****************************************************************************/
+
+void gap8_icache_prof_end(struct gap8_icache_prof_s *prof);
+
+/****************************************************************************
+ * Name: gap8_icache_prof_dump
+ *
+ * Description:
+ *   Print the average cycles, instructions and fetch stall cycles per run,
+ *   and the stall ratio in per mille of cycles, on `uart`.
+ *
+ ****************************************************************************/
+
+void gap8_icache_prof_dump(struct gap8_uart_t *uart, const char *name,
+                           const struct gap8_icache_prof_s *prof);
+
+#endif
@@ -16,8 +16,36 @@
  ************************************************************************************/
 
 #include "gap8_interrupt.h"
+#include "gap8_section.h"
 #include "gap8_udma.h"
+#include "gap8_gpio.h"
 #include "gap8_tim.h"
+#include "gap8_workq.h"
+#include "gap8_irqtrace.h"
+#include <stdbool.h>
+
+/************************************************************************************
+ * Public Data
+ ************************************************************************************/
+
+/* Touched by the wrappers on every IRQ, keep them in FC TCDM */
+volatile uint32_t gap8_irq_nesting GAP8_FC_TCDM_BSS;
+volatile uint32_t gap8_irq_nesting_max GAP8_FC_TCDM_BSS;
+uint32_t * volatile gap8_current_regs GAP8_FC_TCDM_BSS;
+
+/* Touched on every sleep */
+volatile uint32_t * volatile gap8_idle_clock GAP8_FC_TCDM_BSS;
+volatile uint32_t gap8_idle_cycles GAP8_FC_TCDM_BSS;
+volatile uint32_t gap8_idle_start GAP8_FC_TCDM_BSS;
+volatile uint32_t gap8_idle_sleeping GAP8_FC_TCDM_BSS;
+
+/************************************************************************************
+ * Private Data
+ ************************************************************************************/
+
+/* Interrupt stack from GAP8.ld. It grows down from start to end. */
+extern uint32_t __irq_stack_start__[];
+extern uint32_t __irq_stack_end__[];
 
 /************************************************************************************
  * Public Function
@@ -33,6 +61,15 @@
 
 void up_irqinitialize(void)
 {
+  uint32_t *p;
+
+  /* Paint the interrupt stack to track its usage */
+
+  for (p = __irq_stack_end__; p < __irq_stack_start__; p++)
+    {
+      *p = GAP8_IRQSTACK_PAINT;
+    }
+
   /* Deactivate all the soc events */
 
   SOC_EU->FC_MASK_MSB = 0xFFFFFFFF;
@@ -43,19 +80,54 @@ void up_irqinitialize(void)
   up_irq_enable();
 }
 
+/****************************************************************************
+ * Name: gap8_irqstack_usage
+ *
+ * Description:
+ *   Return the deepest usage of the interrupt stack so far, in bytes.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_irqstack_usage(void)
+{
+  uint32_t *p = __irq_stack_end__;
+
+  while (p < __irq_stack_start__ && *p == GAP8_IRQSTACK_PAINT)
+    {
+      p++;
+    }
+
+  return (uint32_t)(__irq_stack_start__ - p) * sizeof(uint32_t);
+}
+
 /****************************************************************************
  * Name: gap8_dispatch_irq
  *
  * Description:
  *   Called from IRQ vectors. Input vector id. Return SP pointer, modified
- *   or not.
+ *   or not. `entry_cycles` is the cycle counter sampled by the wrapper,
+ *   only valid with CONFIG_GAP8_IRQ_TRACE.
  *
  ****************************************************************************/
 
-void* gap8_dispatch_irq(uint32_t vector, void *current_regs)
+void* gap8_dispatch_irq(uint32_t vector, void *current_regs,
+                        uint32_t entry_cycles)
 {
+  uint32_t *saved_regs = gap8_current_regs;
+  bool idle = gap8_irq_nesting == 1 && gap8_idle_sleeping;
+
+  /* Woken up from gap8_sleep_wait_sw_evnt(): not idle while handling */
+
+  if (idle)
+    {
+      gap8_idle_cycles += *gap8_idle_clock - gap8_idle_start;
+    }
+
+  GAP8_IRQTRACE_BEGIN(vector, entry_cycles);
+
+  gap8_current_regs = current_regs;
+
   FCEU->BUFFER_CLEAR = (1 << GAP8_IRQ_FC_UDMA);
-  EU_SW_EVNT_TRIG->TRIGGER_SET[3] = 0;
   // TODO: call nuttx core functions
   if (vector == GAP8_IRQ_FC_UDMA)
     {
@@ -64,8 +136,6 @@ void* gap8_dispatch_irq(uint32_t vector, void *current_regs)
       /* Get current event */
       uint32_t event = SOC_EVENTS->CURRENT_EVENT & 0xff;
 
-      //EU_SW_EVNT_TRIG->TRIGGER_SET[3] = 0;
-      
       /* Clear IRQ pending */
       //FCEU->BUFFER_CLEAR = (1 << GAP8_IRQ_FC_UDMA);
 
@@ -73,12 +143,35 @@ void* gap8_dispatch_irq(uint32_t vector, void *current_regs)
         {
           gap8_udma_doirq(event);
         }
+      else if (event == GAP8_EVENT_GPIO)
+        {
+          gap8_gpio_doirq();
+        }
     }
   else if (vector == GAP8_IRQ_FC_TIMER_LO)
     {
       //FCEU->BUFFER_CLEAR = (1 << GAP8_IRQ_FC_TIMER_LO);
       gap8_timer_isr();
     }
-    
+  else if (vector == GAP8_IRQ_FC_TIMER_HI)
+    {
+      gap8_timer_hi_isr();
+    }
+  else if (vector <= GAP8_IRQ_FC_SW_7)
+    {
+      /* Deferred works */
+
+      gap8_workq_dispatch(vector);
+    }
+
+  gap8_current_regs = saved_regs;
+
+  GAP8_IRQTRACE_END(vector);
+
+  if (idle)
+    {
+      gap8_idle_start = *gap8_idle_clock;
+    }
+
   return current_regs;
 }
\ No newline at end of file
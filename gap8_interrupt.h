@@ -194,6 +194,35 @@ typedef struct {
 #define GAP8_IRQ_ILLEGAL   33
 #define GAP8_IRQ_SYSCALL   34
 
+/* Pattern painted on the interrupt stack to find its high watermark */
+#define GAP8_IRQSTACK_PAINT  0xDEADBEEF
+
+/* Register frame saved by the IRQ wrappers, in words */
+#define GAP8_REG_EPC         0
+#define GAP8_REG_RA          1
+#define GAP8_REG_SP          2
+
+/************************************************************************************
+ * Public Data
+ ************************************************************************************/
+
+/* IRQ nesting level, and its maximum so far. Maintained by the IRQ wrappers. */
+extern volatile uint32_t gap8_irq_nesting;
+extern volatile uint32_t gap8_irq_nesting_max;
+
+/* Register frame of the context interrupted by the IRQ being handled, NULL
+ * out of IRQ. Indexed by GAP8_REG_*. */
+extern uint32_t * volatile gap8_current_regs;
+
+/* Idle accounting of gap8_sleep_wait_sw_evnt(): cycles slept, counted on
+ * gap8_idle_clock if not NULL. Set by the DVFS governor. While asleep, the
+ * outermost IRQ closes the interval in progress, started at gap8_idle_start,
+ * and reopens it on exit, so that the work done in IRQ is not idle.
+ * gap8_idle_cycles is never cleared: readers take deltas. */
+extern volatile uint32_t * volatile gap8_idle_clock;
+extern volatile uint32_t gap8_idle_cycles;
+extern volatile uint32_t gap8_idle_start;
+extern volatile uint32_t gap8_idle_sleeping;
 
 /************************************************************************************
  * Inline Functions
@@ -277,6 +306,19 @@ static inline void up_ack_irq(int irq)
 {
 }
 
+/****************************************************************************
+ * Name: up_interrupt_context
+ *
+ * Description:
+ *   Return nonzero if running in an IRQ handler, on the interrupt stack.
+ *
+ ****************************************************************************/
+
+static inline int up_interrupt_context(void)
+{
+  return gap8_irq_nesting != 0;
+}
+
 /****************************************************************************
  * Name: _current_privilege
  *
@@ -377,14 +419,34 @@ static inline uint32_t up_irq_enable(void)
  * Name: gap8_sleep_wait_sw_evnt
  *
  * Description:
- *   Sleep on specific event.
+ *   Sleep on specific event. The time slept, but the ISR taken meanwhile,
+ *   is accounted in gap8_idle_cycles.
  *
  ****************************************************************************/
 static inline void gap8_sleep_wait_sw_evnt(uint32_t event_mask)
 {
+  volatile uint32_t *clock = gap8_idle_clock;
+  uint32_t flags;
+
+  if (clock)
+    {
+      flags = up_irq_save();
+      gap8_idle_start = *clock;
+      gap8_idle_sleeping = 1;
+      up_irq_restore(flags);
+    }
+
   FCEU->MASK_OR = event_mask;
   __builtin_pulp_event_unit_read((void*)&FCEU->EVENT_WAIT_CLEAR, 0);
   FCEU->MASK_AND = event_mask;
+
+  if (clock)
+    {
+      flags = up_irq_save();
+      gap8_idle_cycles += *clock - gap8_idle_start;
+      gap8_idle_sleeping = 0;
+      up_irq_restore(flags);
+    }
 }
 
 /************************************************************************************
@@ -401,5 +463,16 @@ static inline void gap8_sleep_wait_sw_evnt(uint32_t event_mask)
 
 void up_irqinitialize(void);
 
+/****************************************************************************
+ * Name: gap8_irqstack_usage
+ *
+ * Description:
+ *   Return the deepest usage of the interrupt stack so far, in bytes. The
+ *   size of the stack is __IRQ_STACK_SIZE in GAP8.ld.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_irqstack_usage(void);
+
 
 #endif
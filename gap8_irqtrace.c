@@ -0,0 +1,236 @@
+/************************************************************************************
+ * IRQ latency instrumentation for GAP8 FC
+ *  Per vector log2 histograms of entry-to-handler latency and handler duration,
+ *  in cycles. Only built with CONFIG_GAP8_IRQ_TRACE.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_irqtrace.h"
+#include "gap8_interrupt.h"
+#include "gap8_perf.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "gap8_section.h"
+#ifdef CONFIG_GAP8_IRQ_TRACE
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Histograms are touched on every IRQ, keep them in FC TCDM */
+static struct gap8_irqtrace_slot_s _slots[GAP8_IRQTRACE_NR_SLOTS]
+  GAP8_FC_TCDM_BSS;
+
+/* uDMA cannot read FC TCDM, so format the output in L2 */
+static char _linebuf[128] GAP8_L2_DMA;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Map a vector to its slot. Unused vectors share the last slot. */
+
+static inline int _slot_of(uint32_t vector)
+{
+  if (vector <= GAP8_IRQ_FC_SW_7)
+    {
+      return vector;
+    }
+  if (vector == GAP8_IRQ_FC_TIMER_LO || vector == GAP8_IRQ_FC_TIMER_HI)
+    {
+      return vector - GAP8_IRQ_FC_TIMER_LO + 8;
+    }
+  if (vector >= GAP8_IRQ_FC_UDMA && vector <= GAP8_IRQ_FC_HP_1)
+    {
+      return vector - GAP8_IRQ_FC_UDMA + 10;
+    }
+  return GAP8_IRQTRACE_NR_SLOTS - 1;
+}
+
+static const char *_slot_name(int slot)
+{
+  static const char *names[GAP8_IRQTRACE_NR_SLOTS] = {
+    "sw0", "sw1", "sw2", "sw3", "sw4", "sw5", "sw6", "sw7",
+    "timer_lo", "timer_hi", "udma", "mpu", "udma_err", "fc_hp0", "fc_hp1",
+    "other",
+  };
+
+  return names[slot];
+}
+
+static inline int _bucket_of(uint32_t cycles)
+{
+  int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+
+  return bucket < GAP8_IRQTRACE_NR_BUCKETS ?
+         bucket : GAP8_IRQTRACE_NR_BUCKETS - 1;
+}
+
+static void _send_line(struct gap8_uart_t *uart)
+{
+  gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+}
+
+static void _dump_hist(struct gap8_uart_t *uart, const char *title,
+                       const uint32_t *hist)
+{
+  int i, len;
+
+  len = sprintf(_linebuf, "  %-4s", title);
+  for (i = 0; i < GAP8_IRQTRACE_NR_BUCKETS; i++)
+    {
+      len += sprintf(_linebuf + len, " %lu", (unsigned long)hist[i]);
+    }
+  sprintf(_linebuf + len, "\r\n");
+  _send_line(uart);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_irqtrace_init
+ *
+ * Description:
+ *   Start the cycle counter and clear the histograms.
+ *
+ ****************************************************************************/
+
+void gap8_irqtrace_init(void)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  gap8_perf_select(GAP8_PERF_CYCLES);
+  gap8_perf_start();
+
+  memset(_slots, 0, sizeof(_slots));
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_irqtrace_begin
+ *
+ * Description:
+ *   Called when the handler starts. `entry` is the cycle counter sampled by
+ *   the wrapper. Return the start stamp for gap8_irqtrace_end().
+ *
+ ****************************************************************************/
+
+uint32_t gap8_irqtrace_begin(uint32_t vector, uint32_t entry)
+{
+  struct gap8_irqtrace_slot_s *slot = &_slots[_slot_of(vector)];
+  uint32_t start = gap8_irqtrace_now();
+  uint32_t latency = start - entry;
+
+  slot->count++;
+  slot->latency[_bucket_of(latency)]++;
+  if (latency > slot->latency_max)
+    {
+      slot->latency_max = latency;
+    }
+
+  return start;
+}
+
+/****************************************************************************
+ * Name: gap8_irqtrace_end
+ *
+ * Description:
+ *   Called when the handler returns.
+ *
+ ****************************************************************************/
+
+void gap8_irqtrace_end(uint32_t vector, uint32_t start)
+{
+  struct gap8_irqtrace_slot_s *slot = &_slots[_slot_of(vector)];
+  uint32_t duration = gap8_irqtrace_now() - start;
+
+  slot->duration[_bucket_of(duration)]++;
+  if (duration > slot->duration_max)
+    {
+      slot->duration_max = duration;
+    }
+}
+
+/****************************************************************************
+ * Name: gap8_irqtrace_get
+ *
+ * Description:
+ *   Return the histograms of `vector`, or NULL if tracing is compiled out.
+ *
+ ****************************************************************************/
+
+const struct gap8_irqtrace_slot_s *gap8_irqtrace_get(uint32_t vector)
+{
+  return &_slots[_slot_of(vector)];
+}
+
+/****************************************************************************
+ * Name: gap8_irqtrace_dump
+ *
+ * Description:
+ *   Print the histograms of every vector seen so far on `uart`.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_irqtrace_dump(struct gap8_uart_t *uart)
+{
+  struct gap8_irqtrace_slot_s snap;
+  uint32_t flags;
+  int i;
+
+  sprintf(_linebuf, "irq latency/duration, log2 cycle buckets\r\n");
+  _send_line(uart);
+
+  for (i = 0; i < GAP8_IRQTRACE_NR_SLOTS; i++)
+    {
+      /* Take a consistent copy, the UART itself raises IRQs */
+
+      flags = up_irq_save();
+      snap = _slots[i];
+      up_irq_restore(flags);
+
+      if (snap.count == 0)
+        {
+          continue;
+        }
+
+      sprintf(_linebuf, "%s: n=%lu lat_max=%lu dur_max=%lu\r\n",
+              _slot_name(i), (unsigned long)snap.count,
+              (unsigned long)snap.latency_max,
+              (unsigned long)snap.duration_max);
+      _send_line(uart);
+      _dump_hist(uart, "lat", snap.latency);
+      _dump_hist(uart, "dur", snap.duration);
+    }
+}
+
+#else /* CONFIG_GAP8_IRQ_TRACE */
+
+void gap8_irqtrace_init(void)
+{
+}
+
+const struct gap8_irqtrace_slot_s *gap8_irqtrace_get(uint32_t vector)
+{
+  return NULL;
+}
+
+GAP8_COLD
+void gap8_irqtrace_dump(struct gap8_uart_t *uart)
+{
+}
+
+#endif /* CONFIG_GAP8_IRQ_TRACE */
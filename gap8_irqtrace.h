@@ -0,0 +1,138 @@
+/************************************************************************************
+ * IRQ latency instrumentation for GAP8 FC
+ *  With CONFIG_GAP8_IRQ_TRACE defined, the IRQ wrappers sample the cycle counter
+ *  on trap entry, and gap8_dispatch_irq samples it again when the handler starts
+ *  and when it returns. Per vector, the entry-to-handler latency and the handler
+ *  duration are kept as log2-bucket histograms in FC TCDM:
+ *
+ *    bucket 0: < 2 cycles, bucket n: [2^n, 2^(n+1)), last bucket: everything above
+ *
+ *  The wrappers sample the counter right after reserving the frame, before the
+ *  register save. The hardware delay from the event to the vector, and those few
+ *  instructions, take a fixed number of cycles and are not included. Handlers
+ *  running with interrupts re-enabled (deferred works) account the nested IRQs
+ *  into their duration.
+ *
+ *  Without CONFIG_GAP8_IRQ_TRACE, the hooks compile to nothing.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_IRQTRACE_H
+#define GAP8_IRQTRACE_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include "gap8_uart.h"
+#include "gap8_perf.h"
+#include <stdint.h>
+
+/************************************************************************************
+ * Pre-Processor Declarations
+ ************************************************************************************/
+
+/* Log2 buckets per histogram, the last one collects the overflow */
+#define GAP8_IRQTRACE_NR_BUCKETS  12
+
+/* Traced vectors: SW0-7, TIMER_LO/HI, UDMA, MPU, UDMA_ERR, HP0/1, others */
+#define GAP8_IRQTRACE_NR_SLOTS    16
+
+#ifdef CONFIG_GAP8_IRQ_TRACE
+#  define GAP8_IRQTRACE_BEGIN(vector, entry) \
+     uint32_t __irqtrace_start = gap8_irqtrace_begin(vector, entry)
+#  define GAP8_IRQTRACE_END(vector) \
+     gap8_irqtrace_end(vector, __irqtrace_start)
+#else
+#  define GAP8_IRQTRACE_BEGIN(vector, entry)
+#  define GAP8_IRQTRACE_END(vector)
+#endif
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+struct gap8_irqtrace_slot_s {
+  uint32_t count;
+  uint32_t latency_max;                           /* cycles */
+  uint32_t duration_max;                          /* cycles */
+  uint32_t latency[GAP8_IRQTRACE_NR_BUCKETS];     /* entry to handler */
+  uint32_t duration[GAP8_IRQTRACE_NR_BUCKETS];    /* handler run time */
+};
+
+/************************************************************************************
+ * Inline Functions
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_irqtrace_now
+ *
+ * Description:
+ *   Read the cycle counter (PCCR0).
+ *
+ ****************************************************************************/
+
+static inline uint32_t gap8_irqtrace_now(void)
+{
+  return gap8_perf_read();
+}
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_irqtrace_init
+ *
+ * Description:
+ *   Start the cycle counter and clear the histograms.
+ *
+ ****************************************************************************/
+
+void gap8_irqtrace_init(void);
+
+/****************************************************************************
+ * Name: gap8_irqtrace_begin
+ *
+ * Description:
+ *   Called when the handler starts. `entry` is the cycle counter sampled by
+ *   the wrapper. Return the start stamp for gap8_irqtrace_end().
+ *
+ ****************************************************************************/
+
+uint32_t gap8_irqtrace_begin(uint32_t vector, uint32_t entry);
+
+/****************************************************************************
+ * Name: gap8_irqtrace_end
+ *
+ * Description:
+ *   Called when the handler returns.
+ *
+ ****************************************************************************/
+
+void gap8_irqtrace_end(uint32_t vector, uint32_t start);
+
+/****************************************************************************
+ * Name: gap8_irqtrace_get
+ *
+ * Description:
+ *   Return the histograms of `vector`, or NULL if tracing is compiled out.
+ *
+ ****************************************************************************/
+
+const struct gap8_irqtrace_slot_s *gap8_irqtrace_get(uint32_t vector);
+
+/****************************************************************************
+ * Name: gap8_irqtrace_dump
+ *
+ * Description:
+ *   Print the histograms of every vector seen so far on `uart`.
+ *
+ ****************************************************************************/
+
+void gap8_irqtrace_dump(struct gap8_uart_t *uart);
+
+#endif
@@ -0,0 +1,326 @@
+/************************************************************************************
+ * PC-sampling profiler for GAP8 FC
+ *  Samples the interrupted PC from the high half of the FC timer.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_pcprof.h"
+#include "gap8_interrupt.h"
+#include "gap8_tim.h"
+#include "gap8_fll.h"
+#include "gap8_section.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* From GAP8.ld */
+extern char _stext[];
+
+/* Touched on every sample, keep it in FC TCDM */
+static struct {
+  uint16_t *pc_hist;
+  uint16_t *ra_hist;
+  uint32_t nbuckets;
+  uint32_t shift;
+  uint32_t base;          /* address of bucket 0           */
+  uint32_t period;        /* high half cycles per sample   */
+  uint32_t next;          /* next sample, high half count  */
+  uint32_t samples;
+  uint32_t outside;       /* PC samples out of the buckets */
+  bool running;
+} _pcprof GAP8_FC_TCDM_BSS;
+
+/* uDMA cannot read FC TCDM, so format the output in L2 */
+static char _linebuf[64] GAP8_L2_DMA;
+
+static void _clock_postchange(uint32_t old_hz, uint32_t new_hz, void *arg);
+
+static struct gap8_fll_notifier_s _clock_nb = {
+  .post_change = _clock_postchange,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Return true if counted in a bucket */
+
+static inline bool _count(uint16_t *hist, uint32_t addr)
+{
+  uint32_t bucket = (addr - _pcprof.base) >> _pcprof.shift;
+
+  if (bucket >= _pcprof.nbuckets)
+    {
+      return false;
+    }
+
+  if (hist[bucket] != UINT16_MAX)
+    {
+      hist[bucket]++;
+    }
+
+  return true;
+}
+
+static void _sample(void *arg)
+{
+  uint32_t *regs = gap8_current_regs;
+
+  if (!_pcprof.running)
+    {
+      return;
+    }
+
+  /* Chain from the previous deadline, so that the rate does not depend on
+   * the IRQ latency. Resync if we fell behind. */
+
+  _pcprof.next += _pcprof.period;
+  if (gap8_timer_hi_oneshot_at(_pcprof.next, _sample, NULL) != OK)
+    {
+      _pcprof.next = gap8_timer_hi_now() + _pcprof.period;
+      if (gap8_timer_hi_oneshot_at(_pcprof.next, _sample, NULL) != OK)
+        {
+          /* The high half is gone, e.g. to cascaded mode */
+
+          _pcprof.running = false;
+        }
+    }
+
+  if (regs == NULL)
+    {
+      return;
+    }
+
+  _pcprof.samples++;
+  if (!_count(_pcprof.pc_hist, regs[GAP8_REG_EPC]))
+    {
+      _pcprof.outside++;
+    }
+  if (_pcprof.ra_hist)
+    {
+      _count(_pcprof.ra_hist, regs[GAP8_REG_RA]);
+    }
+}
+
+/* The high half counts at the FLL rate: scale the period, and what is left
+ * to the next sample, as gap8_tim.c does for the pending one-shot. Rearm,
+ * so that the result does not depend on the notifier order. */
+
+static void _clock_postchange(uint32_t old_hz, uint32_t new_hz, void *arg)
+{
+  uint32_t now;
+  int32_t left;
+
+  if (!_pcprof.running)
+    {
+      return;
+    }
+
+  _pcprof.period = (uint32_t)(((uint64_t)_pcprof.period * new_hz) / old_hz);
+  if (_pcprof.period == 0)
+    {
+      _pcprof.period = 1;
+    }
+
+  now = gap8_timer_hi_now();
+  left = (int32_t)(_pcprof.next - now);
+  if (left < 0)
+    {
+      left = 0;
+    }
+  _pcprof.next = now + (uint32_t)(((uint64_t)left * new_hz) / old_hz);
+
+  if (gap8_timer_hi_oneshot_at(_pcprof.next, _sample, NULL) != OK)
+    {
+      _pcprof.next = now + _pcprof.period;
+      if (gap8_timer_hi_oneshot_at(_pcprof.next, _sample, NULL) != OK)
+        {
+          _pcprof.running = false;
+        }
+    }
+}
+
+static void _dump_hist(struct gap8_uart_t *uart, const char *tag,
+                       const uint16_t *hist)
+{
+  uint32_t i;
+
+  for (i = 0; i < _pcprof.nbuckets; i++)
+    {
+      if (hist[i] == 0)
+        {
+          continue;
+        }
+
+      sprintf(_linebuf, "%s %08lx %u\r\n", tag,
+              (unsigned long)(_pcprof.base + (i << _pcprof.shift)),
+              (unsigned)hist[i]);
+      gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_pcprof_init
+ *
+ * Description:
+ *   Set the histograms. Return ERROR if running.
+ *
+ ****************************************************************************/
+
+int gap8_pcprof_init(uint16_t *pc_hist, uint16_t *ra_hist,
+                     uint32_t nbuckets, uint32_t shift)
+{
+  if (_pcprof.running || pc_hist == NULL || nbuckets == 0)
+    {
+      return ERROR;
+    }
+
+  _pcprof.pc_hist = pc_hist;
+  _pcprof.ra_hist = ra_hist;
+  _pcprof.nbuckets = nbuckets;
+  _pcprof.shift = shift;
+  _pcprof.base = (uint32_t)_stext;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_pcprof_start
+ *
+ * Description:
+ *   Clear the histograms and sample `rate` times per second.
+ *
+ ****************************************************************************/
+
+int gap8_pcprof_start(uint32_t rate)
+{
+  uint32_t flags;
+  int ret;
+
+  if (_pcprof.pc_hist == NULL || rate == 0)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  memset(_pcprof.pc_hist, 0, _pcprof.nbuckets * sizeof(uint16_t));
+  if (_pcprof.ra_hist)
+    {
+      memset(_pcprof.ra_hist, 0, _pcprof.nbuckets * sizeof(uint16_t));
+    }
+  _pcprof.samples = 0;
+  _pcprof.outside = 0;
+
+  _pcprof.period = gap8_timer_hi_us_to_cycles(1000000) / rate;
+  _pcprof.next = gap8_timer_hi_now() + _pcprof.period;
+  _pcprof.running = true;
+
+  ret = gap8_timer_hi_oneshot_at(_pcprof.next, _sample, NULL);
+  if (ret != OK)
+    {
+      _pcprof.running = false;
+    }
+  else
+    {
+      gap8_fll_register_notifier(&_clock_nb);
+    }
+
+  up_irq_restore(flags);
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: gap8_pcprof_stop
+ *
+ * Description:
+ *   Stop sampling. The histograms are kept.
+ *
+ ****************************************************************************/
+
+void gap8_pcprof_stop(void)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (_pcprof.running)
+    {
+      _pcprof.running = false;
+      gap8_timer_hi_cancel(_sample);
+    }
+  gap8_fll_unregister_notifier(&_clock_nb);
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_pcprof_running
+ *
+ * Description:
+ *   Return true while sampling. The next sample must still be pending:
+ *   gap8_timer_cascade_initialize() takes the high half without notice.
+ *
+ ****************************************************************************/
+
+bool gap8_pcprof_running(void)
+{
+  uint32_t flags;
+  bool running;
+
+  flags = up_irq_save();
+  if (_pcprof.running && !gap8_timer_hi_pending(_sample))
+    {
+      _pcprof.running = false;
+    }
+  running = _pcprof.running;
+  up_irq_restore(flags);
+
+  return running;
+}
+
+/****************************************************************************
+ * Name: gap8_pcprof_dump
+ *
+ * Description:
+ *   Print the non-empty buckets on `uart`.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_pcprof_dump(struct gap8_uart_t *uart)
+{
+  if (_pcprof.pc_hist == NULL)
+    {
+      return;
+    }
+
+  sprintf(_linebuf, "pcprof begin %lu %lu %lu\r\n",
+          (unsigned long)_pcprof.samples, (unsigned long)_pcprof.outside,
+          (unsigned long)_pcprof.shift);
+  gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+
+  _dump_hist(uart, "pc", _pcprof.pc_hist);
+  if (_pcprof.ra_hist)
+    {
+      _dump_hist(uart, "ra", _pcprof.ra_hist);
+    }
+
+  sprintf(_linebuf, "pcprof end\r\n");
+  gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+}
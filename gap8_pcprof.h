@@ -0,0 +1,107 @@
+/************************************************************************************
+ * PC-sampling profiler for GAP8 FC
+ *  The high half of the FC timer interrupts at a fixed rate, and the sampler
+ *  looks at the register frame of the interrupted context: its PC, and
+ *  optionally its return address to credit the callers of leaf functions, are
+ *  counted into histograms in L2. No code instrumentation is needed, and time
+ *  spent with interrupts disabled is credited to the instruction re-enabling
+ *  them.
+ *
+ *  Histograms cover .text in buckets of 2^shift bytes, with 16-bit saturating
+ *  counts. 2 is instruction granularity (4 bytes, or 2 RVC instructions); samples
+ *  out of range are only counted. gap8_pcprof_dump() prints the non-empty buckets
+ *  over UART, and pcprof.py symbolizes a captured log against the ELF:
+ *
+ *    static uint16_t pc_hist[8192], ra_hist[8192];
+ *
+ *    gap8_timer_hi_initialize(freq);
+ *    gap8_pcprof_init(pc_hist, ra_hist, 8192, 2);
+ *    gap8_pcprof_start(997);
+ *    ...
+ *    gap8_pcprof_stop();
+ *    gap8_pcprof_dump(uart);
+ *
+ *  Pick a rate that is not a multiple of the tick, or periodic code would be
+ *  aliased. The sampler owns the high half one-shot while running, and follows
+ *  gap8_setfreq(): other users of gap8_timer_hi_oneshot() are refused until
+ *  gap8_pcprof_stop(), and gap8_pcprof_start() fails while they hold it. If the
+ *  one-shot is lost, e.g. once the timer is switched to cascaded mode, sampling
+ *  stops: see gap8_pcprof_running().
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_PCPROF_H
+#define GAP8_PCPROF_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include "gap8_uart.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_pcprof_init
+ *
+ * Description:
+ *   Set the histograms, `nbuckets` counts each, covering .text from its
+ *   start by buckets of 2^shift bytes. `ra_hist` may be NULL. The buffers
+ *   must stay valid while the profiler runs. Return ERROR if running.
+ *
+ ****************************************************************************/
+
+int gap8_pcprof_init(uint16_t *pc_hist, uint16_t *ra_hist,
+                     uint32_t nbuckets, uint32_t shift);
+
+/****************************************************************************
+ * Name: gap8_pcprof_start
+ *
+ * Description:
+ *   Clear the histograms and sample `rate` times per second. Return ERROR
+ *   if not initialized, or if the high half of the timer is not running.
+ *
+ ****************************************************************************/
+
+int gap8_pcprof_start(uint32_t rate);
+
+/****************************************************************************
+ * Name: gap8_pcprof_stop
+ *
+ * Description:
+ *   Stop sampling. The histograms are kept.
+ *
+ ****************************************************************************/
+
+void gap8_pcprof_stop(void);
+
+/****************************************************************************
+ * Name: gap8_pcprof_running
+ *
+ * Description:
+ *   Return true while sampling: false after gap8_pcprof_stop(), or when
+ *   the sampler lost the high half of the timer.
+ *
+ ****************************************************************************/
+
+bool gap8_pcprof_running(void);
+
+/****************************************************************************
+ * Name: gap8_pcprof_dump
+ *
+ * Description:
+ *   Print the non-empty buckets on `uart`, in the format read by
+ *   pcprof.py.
+ *
+ ****************************************************************************/
+
+void gap8_pcprof_dump(struct gap8_uart_t *uart);
+
+#endif
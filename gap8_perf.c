@@ -0,0 +1,208 @@
+/************************************************************************************
+ * Performance counters of GAP8 FC
+ *  Named counters over the single core performance counter.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_perf.h"
+#include "gap8_interrupt.h"
+#include "gap8_section.h"
+#include <stdio.h>
+#include <string.h>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Counters run at least once */
+static struct gap8_perf_counter_s *_counters;
+
+/* uDMA cannot read FC TCDM, so format the output in L2 */
+static char _linebuf[128] GAP8_L2_DMA;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static const char *_event_name(uint32_t event)
+{
+  static const char *names[] = {
+    "cycles", "instr", "ld_stall", "jr_stall", "imiss", "ld", "st", "jump",
+    "branch", "btaken", "rvc", "ld_ext", "st_ext", "ld_ext_cyc", "st_ext_cyc",
+    "tcdm_cont",
+  };
+  uint32_t bit = event ? __builtin_ctz(event) : 0;
+
+  return bit < sizeof(names) / sizeof(names[0]) ? names[bit] : "?";
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_perf_counter_start
+ *
+ * Description:
+ *   Start a run of a named counter.
+ *
+ ****************************************************************************/
+
+void gap8_perf_counter_start(struct gap8_perf_counter_s *counter)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (!counter->registered)
+    {
+      counter->next = _counters;
+      _counters = counter;
+      counter->registered = 1;
+    }
+
+  counter->pcer = gap8_perf_events();
+  if (counter->pcer != counter->event)
+    {
+      gap8_perf_select(counter->event);
+    }
+  counter->start = gap8_perf_read();
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_perf_counter_stop
+ *
+ * Description:
+ *   End a run of a named counter and accumulate its count.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_perf_counter_stop(struct gap8_perf_counter_s *counter)
+{
+  uint32_t count = gap8_perf_read() - counter->start;
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (counter->pcer != counter->event)
+    {
+      gap8_perf_select(counter->pcer);
+    }
+
+  if (counter->runs == 0 || count < counter->min)
+    {
+      counter->min = count;
+    }
+  if (count > counter->max)
+    {
+      counter->max = count;
+    }
+  counter->total += count;
+  counter->runs++;
+
+  up_irq_restore(flags);
+
+  return count;
+}
+
+/****************************************************************************
+ * Name: gap8_perf_counter_reset
+ *
+ * Description:
+ *   Clear the accumulated counts of a named counter.
+ *
+ ****************************************************************************/
+
+void gap8_perf_counter_reset(struct gap8_perf_counter_s *counter)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  counter->runs = 0;
+  counter->total = 0;
+  counter->min = 0;
+  counter->max = 0;
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_perf_scope_begin / gap8_perf_scope_end
+ *
+ * Description:
+ *   Used by GAP8_PERF_SCOPE().
+ *
+ ****************************************************************************/
+
+struct gap8_perf_counter_s *
+gap8_perf_scope_begin(struct gap8_perf_counter_s *counter)
+{
+  gap8_perf_counter_start(counter);
+
+  return counter;
+}
+
+void gap8_perf_scope_end(struct gap8_perf_counter_s **counter)
+{
+  gap8_perf_counter_stop(*counter);
+}
+
+/****************************************************************************
+ * Name: gap8_perf_dump
+ *
+ * Description:
+ *   Print every named counter run so far on `uart`.
+ *
+ ****************************************************************************/
+
+GAP8_COLD
+void gap8_perf_dump(struct gap8_uart_t *uart)
+{
+  struct gap8_perf_counter_s *counter;
+  struct gap8_perf_counter_s snap;
+  uint32_t flags;
+
+  sprintf(_linebuf, "%-16s %-10s %8s %10s %10s %10s\r\n",
+          "counter", "event", "runs", "mean", "min", "max");
+  gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+
+  for (counter = _counters; counter; counter = counter->next)
+    {
+      flags = up_irq_save();
+      snap = *counter;
+      up_irq_restore(flags);
+
+      sprintf(_linebuf, "%-16s %-10s %8lu %10lu %10lu %10lu\r\n",
+              snap.name, _event_name(snap.event), (unsigned long)snap.runs,
+              (unsigned long)(snap.runs ? snap.total / snap.runs : 0),
+              (unsigned long)snap.min, (unsigned long)snap.max);
+      gap8_uart_sendbytes(uart, (uint8_t*)_linebuf, strlen(_linebuf));
+    }
+}
+
+/****************************************************************************
+ * Name: gap8_perf_reset_all
+ *
+ * Description:
+ *   Clear the accumulated counts of every named counter.
+ *
+ ****************************************************************************/
+
+void gap8_perf_reset_all(void)
+{
+  struct gap8_perf_counter_s *counter;
+
+  for (counter = _counters; counter; counter = counter->next)
+    {
+      gap8_perf_counter_reset(counter);
+    }
+}
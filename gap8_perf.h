@@ -0,0 +1,244 @@
+/************************************************************************************
+ * Performance counters of GAP8 FC
+ *  RI5CY counts events selected in PCER (0x7E0) into PCCR0 (0x780), while PCMR
+ *  (0x7E1) enables it. GAP8 FC only implements that single counter: it counts the
+ *  cycles where any selected event occurs, so select one event at a time to get
+ *  meaningful numbers. reset_handler enables it counting cycles, which is what
+ *  the boot profiler and the IRQ trace expect; measurements of other events
+ *  restore the cycle count when they stop.
+ *
+ *  Named counters accumulate the count of one event over the runs of a block,
+ *  and are all dumpable over UART:
+ *
+ *    GAP8_PERF_COUNTER(udma_irq_perf, "udma irq", GAP8_PERF_CYCLES);
+ *
+ *    void gap8_udma_doirq(uint32_t irqn)
+ *    {
+ *      GAP8_PERF_SCOPE(udma_irq_perf);
+ *      ...
+ *    }
+ *
+ *    gap8_perf_dump(uart);
+ *
+ *  The scope ends with the enclosing block, whatever the way out. Scopes may
+ *  nest if they count the same event.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_PERF_H
+#define GAP8_PERF_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include "gap8_uart.h"
+#include <stdint.h>
+
+/************************************************************************************
+ * Pre-Processor Declarations
+ ************************************************************************************/
+
+/* PCER event bits */
+#define GAP8_PERF_CYCLES      (1L << 0)   /* cycles                           */
+#define GAP8_PERF_INSTR       (1L << 1)   /* retired instructions             */
+#define GAP8_PERF_LD_STALL    (1L << 2)   /* load use hazards                 */
+#define GAP8_PERF_JR_STALL    (1L << 3)   /* jump register hazards            */
+#define GAP8_PERF_IMISS       (1L << 4)   /* cycles waiting for fetch         */
+#define GAP8_PERF_LD          (1L << 5)   /* loads                            */
+#define GAP8_PERF_ST          (1L << 6)   /* stores                           */
+#define GAP8_PERF_JUMP        (1L << 7)   /* unconditional jumps              */
+#define GAP8_PERF_BRANCH      (1L << 8)   /* branches                         */
+#define GAP8_PERF_BTAKEN      (1L << 9)   /* taken branches                   */
+#define GAP8_PERF_RVC         (1L << 10)  /* compressed instructions          */
+#define GAP8_PERF_LD_EXT      (1L << 11)  /* loads out of TCDM                */
+#define GAP8_PERF_ST_EXT      (1L << 12)  /* stores out of TCDM               */
+#define GAP8_PERF_LD_EXT_CYC  (1L << 13)  /* cycles of loads out of TCDM      */
+#define GAP8_PERF_ST_EXT_CYC  (1L << 14)  /* cycles of stores out of TCDM     */
+#define GAP8_PERF_TCDM_CONT   (1L << 15)  /* cycles of TCDM contention        */
+
+/* Declare a named counter of `event` */
+#define GAP8_PERF_COUNTER(var, name, event) \
+  struct gap8_perf_counter_s var = { (name), (event) }
+
+/* Count `counter`'s event until the end of the enclosing block */
+#define GAP8_PERF_SCOPE(counter) \
+  GAP8_PERF_SCOPE_AT(counter, __LINE__)
+#define GAP8_PERF_SCOPE_AT(counter, line) \
+  GAP8_PERF_SCOPE_VAR(counter, line)
+#define GAP8_PERF_SCOPE_VAR(counter, line) \
+  struct gap8_perf_counter_s *gap8_perf_scope_##line \
+    __attribute__((cleanup(gap8_perf_scope_end))) = \
+    gap8_perf_scope_begin(&(counter))
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+struct gap8_perf_counter_s {
+  const char *name;
+  uint32_t event;                       /* one GAP8_PERF_* bit          */
+  uint32_t runs;
+  uint64_t total;
+  uint32_t min;
+  uint32_t max;
+  uint32_t start;                       /* PCCR0 when started           */
+  uint32_t pcer;                        /* PCER to restore when stopped */
+  struct gap8_perf_counter_s *next;     /* registered counters          */
+  uint32_t registered;
+};
+
+/************************************************************************************
+ * Inline Functions
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_perf_read
+ *
+ * Description:
+ *   Read the counter.
+ *
+ ****************************************************************************/
+
+static inline uint32_t gap8_perf_read(void)
+{
+  uint32_t count;
+
+  asm volatile ("csrr %0, 0x780" : "=r" (count));
+
+  return count;
+}
+
+/****************************************************************************
+ * Name: gap8_perf_write
+ *
+ * Description:
+ *   Set the counter, e.g. 0 to restart.
+ *
+ ****************************************************************************/
+
+static inline void gap8_perf_write(uint32_t count)
+{
+  asm volatile ("csrw 0x780, %0" : : "r" (count));
+}
+
+/****************************************************************************
+ * Name: gap8_perf_events
+ *
+ * Description:
+ *   Return the events counted, GAP8_PERF_* bits.
+ *
+ ****************************************************************************/
+
+static inline uint32_t gap8_perf_events(void)
+{
+  uint32_t pcer;
+
+  asm volatile ("csrr %0, 0x7E0" : "=r" (pcer));
+
+  return pcer;
+}
+
+/****************************************************************************
+ * Name: gap8_perf_select
+ *
+ * Description:
+ *   Select the events to count, GAP8_PERF_* bits.
+ *
+ ****************************************************************************/
+
+static inline void gap8_perf_select(uint32_t events)
+{
+  asm volatile ("csrw 0x7E0, %0" : : "r" (events));
+}
+
+/****************************************************************************
+ * Name: gap8_perf_start / gap8_perf_stop
+ *
+ * Description:
+ *   Globally enable or freeze the counter (PCMR).
+ *
+ ****************************************************************************/
+
+static inline void gap8_perf_start(void)
+{
+  asm volatile ("csrw 0x7E1, %0" : : "r" (0x1));
+}
+
+static inline void gap8_perf_stop(void)
+{
+  asm volatile ("csrw 0x7E1, %0" : : "r" (0x0));
+}
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_perf_counter_start
+ *
+ * Description:
+ *   Start a run of a named counter.
+ *
+ ****************************************************************************/
+
+void gap8_perf_counter_start(struct gap8_perf_counter_s *counter);
+
+/****************************************************************************
+ * Name: gap8_perf_counter_stop
+ *
+ * Description:
+ *   End a run of a named counter and accumulate its count. Return the
+ *   count of this run.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_perf_counter_stop(struct gap8_perf_counter_s *counter);
+
+/****************************************************************************
+ * Name: gap8_perf_counter_reset
+ *
+ * Description:
+ *   Clear the accumulated counts of a named counter.
+ *
+ ****************************************************************************/
+
+void gap8_perf_counter_reset(struct gap8_perf_counter_s *counter);
+
+/****************************************************************************
+ * Name: gap8_perf_scope_begin / gap8_perf_scope_end
+ *
+ * Description:
+ *   Used by GAP8_PERF_SCOPE().
+ *
+ ****************************************************************************/
+
+struct gap8_perf_counter_s *
+gap8_perf_scope_begin(struct gap8_perf_counter_s *counter);
+void gap8_perf_scope_end(struct gap8_perf_counter_s **counter);
+
+/****************************************************************************
+ * Name: gap8_perf_dump
+ *
+ * Description:
+ *   Print every named counter run so far on `uart`: runs, mean, min and
+ *   max.
+ *
+ ****************************************************************************/
+
+void gap8_perf_dump(struct gap8_uart_t *uart);
+
+/****************************************************************************
+ * Name: gap8_perf_reset_all
+ *
+ * Description:
+ *   Clear the accumulated counts of every named counter.
+ *
+ ****************************************************************************/
+
+void gap8_perf_reset_all(void);
+
+#endif
@@ -0,0 +1,311 @@
+/************************************************************************************
+ * Retentive deep sleep of GAP8
+ *  Saves the clock and pad setup to retained L2, and puts it back on the warm
+ *  boot.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_pm.h"
+#include "gap8_rtc.h"
+#include "gap8_fll.h"
+#include "gap8_interrupt.h"
+#include "gap8_section.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define NELEM(a)              (sizeof(a) / sizeof((a)[0]))
+
+/* ICU state: regulator mode << 1 | cluster on */
+#define PMU_REGU_NV           0
+#define PMU_REGU_RV           2
+#define PMU_STATE(regu, cl)   (((regu) << 1) | (cl))
+#define PMU_STATE_RETENTIVE   PMU_STATE(PMU_REGU_RV, 0)
+
+/* DCDC setting: mV = 550 + 50 * NV */
+#define DCDC_BASE_MV          550
+#define DCDC_STEP_MV          50
+#define DCDC_MAX_MV           (DCDC_BASE_MV + DCDC_STEP_MV * PMU_CTRL_RAR_DCDC_NV_MASK)
+
+/* SLEEP_CTRL.REBOOT: how the ROM boots on the next wake-up */
+#define PMU_BOOT_COLD         0
+#define PMU_BOOT_RETENTIVE    2
+
+/* Retain every L2 bank: the ROM jumps back to the code in place */
+#define PMU_MEM_RET_ALL       0xF
+
+/* Tells saved state from what L2 holds after a cold boot */
+#define PM_MAGIC              0x52455441
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct pm_state_s {
+  uint32_t magic;
+  uint32_t hz;
+  uint32_t padfun[NELEM(PORTA->PADFUN)];
+  uint32_t padcfg[NELEM(PORTA->PADCFG)];
+  uint32_t gpio_dir;
+  uint32_t gpio_out;
+  uint32_t gpio_en;
+  uint32_t gpio_inten;
+  uint32_t gpio_intcfg[NELEM(GPIOA->INTCFG)];
+  uint32_t gpio_padcfg[NELEM(GPIOA->PADCFG)];
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct pm_state_s _state GAP8_L2_RETAINED;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Write a PMU register through the PICL bus */
+
+static void _pmu_write(uint32_t addr, uint32_t value)
+{
+  PMU_DLC->PCTRL = PMU_DLC_PCTRL_PWDATA(value) |
+                   PMU_DLC_PCTRL_PADDR(addr) |
+                   PMU_DLC_PCTRL_START(1);
+  while (PMU_DLC->DLC_SR & PMU_DLC_SR_PICL_BUSY_MASK)
+    ;
+}
+
+static void _save(void)
+{
+  uint32_t i;
+
+  _state.hz = gap8_getfreq();
+
+  for (i = 0; i < NELEM(_state.padfun); i++)
+    {
+      _state.padfun[i] = PORTA->PADFUN[i];
+    }
+  for (i = 0; i < NELEM(_state.padcfg); i++)
+    {
+      _state.padcfg[i] = PORTA->PADCFG[i];
+    }
+
+  _state.gpio_dir = GPIOA->DIR;
+  _state.gpio_out = GPIOA->OUT;
+  _state.gpio_en = GPIOA->EN;
+  _state.gpio_inten = GPIOA->INTEN;
+  for (i = 0; i < NELEM(_state.gpio_intcfg); i++)
+    {
+      _state.gpio_intcfg[i] = GPIOA->INTCFG[i];
+    }
+  for (i = 0; i < NELEM(_state.gpio_padcfg); i++)
+    {
+      _state.gpio_padcfg[i] = GPIOA->PADCFG[i];
+    }
+
+  _state.magic = PM_MAGIC;
+}
+
+/* Levels before directions, and the pad functions last, so that no output
+ * glitches */
+
+static void _restore(void)
+{
+  uint32_t i;
+
+  GPIOA->OUT = _state.gpio_out;
+  GPIOA->DIR = _state.gpio_dir;
+  GPIOA->EN = _state.gpio_en;
+  for (i = 0; i < NELEM(_state.gpio_padcfg); i++)
+    {
+      GPIOA->PADCFG[i] = _state.gpio_padcfg[i];
+    }
+  for (i = 0; i < NELEM(_state.gpio_intcfg); i++)
+    {
+      GPIOA->INTCFG[i] = _state.gpio_intcfg[i];
+    }
+  GPIOA->INTEN = _state.gpio_inten;
+
+  for (i = 0; i < NELEM(_state.padcfg); i++)
+    {
+      PORTA->PADCFG[i] = _state.padcfg[i];
+    }
+  for (i = 0; i < NELEM(_state.padfun); i++)
+    {
+      PORTA->PADFUN[i] = _state.padfun[i];
+    }
+
+  /* The FLL is retained: only relock if the ROM moved it */
+
+  if (gap8_getfreq() != _state.hz)
+    {
+      gap8_setfreq(_state.hz);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_pm_get_voltage
+ *
+ * Description:
+ *   Return the nominal DCDC setting in mV.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_pm_get_voltage(void)
+{
+  return DCDC_BASE_MV +
+         READ_PMU_CTRL_RAR_DCDC_NV(PMU_CTRL->RAR_DCDC) * DCDC_STEP_MV;
+}
+
+/****************************************************************************
+ * Name: gap8_pm_set_voltage
+ *
+ * Description:
+ *   Set the nominal DCDC setting, and request the nominal mode again over
+ *   PICL so that the regulator takes it. The cluster power is kept as is.
+ *
+ ****************************************************************************/
+
+int gap8_pm_set_voltage(uint32_t mv)
+{
+  uint32_t flags, cluster;
+
+  if (mv < DCDC_BASE_MV || mv > DCDC_MAX_MV)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  PMU_CTRL->RAR_DCDC = (PMU_CTRL->RAR_DCDC & ~PMU_CTRL_RAR_DCDC_NV_MASK) |
+    PMU_CTRL_RAR_DCDC_NV((mv - DCDC_BASE_MV) / DCDC_STEP_MV);
+
+  cluster = (SOC_CTRL->CLUSTER_ISO & 0x1) ? 0 : 1;
+  _pmu_write(ICU_CR, PMU_STATE(PMU_REGU_NV, cluster));
+
+  /* Wait for the ICU to be done with the mode change */
+
+  while (PMU_DLC->DLC_SR & PMU_DLC_SR_SCU_BUSY_MASK)
+    ;
+
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_pm_deep_sleep
+ *
+ * Description:
+ *   Save the state to restore, and enter retentive deep sleep until one of
+ *   the wake-up sources of `wake`.
+ *
+ ****************************************************************************/
+
+int gap8_pm_deep_sleep(const struct gap8_pm_wake_s *wake)
+{
+  uint32_t sleep_ctrl;
+
+  if (wake->rtc_seconds == 0 && wake->gpio_pinset == 0)
+    {
+      return ERROR;
+    }
+
+  if (wake->gpio_pinset &&
+      (((wake->gpio_pinset >> 8) & 0x3) != 1 ||
+       wake->gpio_type > GAP8_PM_WAKE_LOW))
+    {
+      return ERROR;
+    }
+
+  if (wake->rtc_seconds)
+    {
+      gap8_rtc_initialize();
+    }
+
+  up_irq_save();
+
+  _save();
+
+  sleep_ctrl = PMU_CTRL_SLEEP_CTRL_CFG_MEM_RET(PMU_MEM_RET_ALL) |
+               PMU_CTRL_SLEEP_CTRL_CFG_FLL_SOC_RET(1) |
+               PMU_CTRL_SLEEP_CTRL_BOOT_L2(1) |
+               PMU_CTRL_SLEEP_CTRL_REBOOT(PMU_BOOT_RETENTIVE);
+
+  if (wake->gpio_pinset)
+    {
+      sleep_ctrl |=
+        PMU_CTRL_SLEEP_CTRL_EXT_WAKE_SEL((wake->gpio_pinset >> 10) & 0x1f) |
+        PMU_CTRL_SLEEP_CTRL_EXT_WAKE_TYPE(wake->gpio_type) |
+        PMU_CTRL_SLEEP_CTRL_EXT_WAKE_EN(1);
+    }
+
+  PMU_CTRL->SLEEP_CTRL = sleep_ctrl;
+
+  if (wake->rtc_seconds)
+    {
+      gap8_rtc_countdown_start(wake->rtc_seconds, false);
+    }
+
+  _pmu_write(ICU_CR, PMU_STATE_RETENTIVE);
+
+  /* The PMU cuts the power */
+
+  for (; ; )
+    ;
+}
+
+/****************************************************************************
+ * Name: gap8_pm_resume
+ *
+ * Description:
+ *   After a retentive deep sleep, restore the state saved by
+ *   gap8_pm_deep_sleep() and return the wake-up source.
+ *
+ ****************************************************************************/
+
+enum gap8_pm_wakeup_e gap8_pm_resume(void)
+{
+  uint32_t sleep_ctrl = PMU_CTRL->SLEEP_CTRL;
+  enum gap8_pm_wakeup_e why;
+
+  if (READ_PMU_CTRL_SLEEP_CTRL_REBOOT(sleep_ctrl) != PMU_BOOT_RETENTIVE ||
+      _state.magic != PM_MAGIC)
+    {
+      _state.magic = 0;
+      return GAP8_PM_COLD_BOOT;
+    }
+
+  /* A reset from here on boots cold */
+
+  PMU_CTRL->SLEEP_CTRL = (sleep_ctrl & ~(PMU_CTRL_SLEEP_CTRL_REBOOT_MASK |
+                                         PMU_CTRL_SLEEP_CTRL_BOOT_L2_MASK |
+                                         PMU_CTRL_SLEEP_CTRL_EXT_WAKE_EN_MASK)) |
+                         PMU_CTRL_SLEEP_CTRL_REBOOT(PMU_BOOT_COLD);
+  _state.magic = 0;
+
+  _restore();
+
+  if (gap8_rtc_countdown_expired())
+    {
+      why = GAP8_PM_WAKE_RTC;
+    }
+  else
+    {
+      why = GAP8_PM_WAKE_GPIO;
+    }
+  gap8_rtc_countdown_stop();
+
+  return why;
+}
@@ -0,0 +1,133 @@
+/************************************************************************************
+ * Retentive deep sleep of GAP8
+ *  In retentive deep sleep the SoC is powered off but for the always-on domain:
+ *  the PMU, the RTC and the pads, plus the L2 banks kept in retention. It wakes
+ *  on the RTC countdown or on an edge or level of one GPIO, and the ROM then
+ *  jumps back to the program in L2 without reloading it from flash.
+ *
+ *  Waking is a warm boot through reset_handler: FC TCDM and the peripherals are
+ *  lost, and every driver structure is back to its initial value, .data being
+ *  reloaded from its image and BSS cleared as on a cold boot. What is slow to
+ *  get back is saved to retained L2 before sleeping, and restored by
+ *  gap8_pm_resume():
+ *  - the SoC FLL setting: the FLL is retained, so most wakes need no relock;
+ *  - the pad functions and configuration, and the GPIO directions, levels and
+ *    interrupt setup, so that outputs come back at their level.
+ *  The rest is the usual software initialization, which is cheap. The uDMA
+ *  channel clocks in particular come back as the drivers take their
+ *  references again through gap8_udma_init():
+ *
+ *    int main(void)
+ *    {
+ *      enum gap8_pm_wakeup_e why = gap8_pm_resume();
+ *
+ *      up_irqinitialize();
+ *      freq = gap8_getfreq();
+ *      if (why == GAP8_PM_COLD_BOOT)
+ *        {
+ *          freq = gap8_setfreq(TARGET_CLK_HZ);
+ *          ...  one-time setup
+ *        }
+ *      uart0 = gap8_uart_initialize(0);
+ *      gap8_uart_setbaud(uart0, 115200, freq);
+ *      ...  work
+ *
+ *      struct gap8_pm_wake_s wake = { .rtc_seconds = 10 };
+ *      gap8_pm_deep_sleep(&wake);
+ *    }
+ *
+ *  Application state meant to survive goes to GAP8_L2_RETAINED objects, which
+ *  read garbage after a cold boot.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_PM_H
+#define GAP8_PM_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include <stdint.h>
+
+/************************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************************/
+
+/* Level or edge of the GPIO wake-up */
+
+#define GAP8_PM_WAKE_RISING     0
+#define GAP8_PM_WAKE_FALLING    1
+#define GAP8_PM_WAKE_HIGH       2
+#define GAP8_PM_WAKE_LOW        3
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+enum gap8_pm_wakeup_e {
+  GAP8_PM_COLD_BOOT = 0,    /* power on, reset, or nothing to restore */
+  GAP8_PM_WAKE_RTC,         /* the RTC countdown expired */
+  GAP8_PM_WAKE_GPIO,        /* the wake-up GPIO */
+};
+
+struct gap8_pm_wake_s {
+  uint32_t rtc_seconds;     /* 0 for none */
+  uint32_t gpio_pinset;     /* a GAP8_PIN_xx_GPIOAn, or 0 for none */
+  uint32_t gpio_type;       /* GAP8_PM_WAKE_xxx */
+};
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_pm_get_voltage
+ *
+ * Description:
+ *   Return the nominal DCDC setting in mV.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_pm_get_voltage(void);
+
+/****************************************************************************
+ * Name: gap8_pm_set_voltage
+ *
+ * Description:
+ *   Set the nominal DCDC setting, from 550 to 2100mV by 50, and have the
+ *   PMU apply it. Returns once the regulator mode change is done; the rail
+ *   itself still takes a while to settle. ERROR if out of range.
+ *
+ ****************************************************************************/
+
+int gap8_pm_set_voltage(uint32_t mv);
+
+/****************************************************************************
+ * Name: gap8_pm_deep_sleep
+ *
+ * Description:
+ *   Save the state to restore, and enter retentive deep sleep until one of
+ *   the wake-up sources of `wake`. The wake-up pin must be configured as a
+ *   GPIO input. Does not return, but ERROR on a bad `wake`.
+ *
+ ****************************************************************************/
+
+int gap8_pm_deep_sleep(const struct gap8_pm_wake_s *wake);
+
+/****************************************************************************
+ * Name: gap8_pm_resume
+ *
+ * Description:
+ *   Call first thing in main(). After a retentive deep sleep, restore the
+ *   state saved by gap8_pm_deep_sleep() and return the wake-up source.
+ *   Otherwise return GAP8_PM_COLD_BOOT.
+ *
+ ****************************************************************************/
+
+enum gap8_pm_wakeup_e gap8_pm_resume(void);
+
+#endif
@@ -0,0 +1,257 @@
+/************************************************************************************
+ * RTC driver for GAP8
+ *  Registers are reached indirectly through the APB bridge.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_rtc.h"
+#include "gap8_interrupt.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* From the 32K reference down to the 1Hz calendar and countdown clock */
+#define RTC_REF_HZ        32768
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* The bridge holds one request at a time: callers disable IRQ */
+
+static uint32_t _read(uint32_t addr)
+{
+  uint32_t data;
+
+  RTC_APB->REQUEST = RTC_APB_REQUEST_ACCESS_ADDR(addr);
+  while (!(RTC_APB->IRQ_FLAG & RTC_APB_IRQ_FLAG_READ_MASK))
+    ;
+  data = RTC_APB->DATA;
+  RTC_APB->IRQ_FLAG = RTC_APB_IRQ_FLAG_READ_MASK;
+
+  return data;
+}
+
+static void _write(uint32_t addr, uint32_t data)
+{
+  RTC_APB->DATA = data;
+  RTC_APB->REQUEST = RTC_APB_REQUEST_ACCESS_ADDR(addr) |
+                     RTC_APB_REQUEST_ACCESS_RW(1);
+  while (!(RTC_APB->IRQ_FLAG & RTC_APB_IRQ_FLAG_WRITE_MASK))
+    ;
+  RTC_APB->IRQ_FLAG = RTC_APB_IRQ_FLAG_WRITE_MASK;
+}
+
+static inline uint32_t _to_bcd(uint32_t val)
+{
+  return ((val / 10) << 4) | (val % 10);
+}
+
+static inline uint32_t _from_bcd(uint32_t bcd)
+{
+  return (bcd >> 4) * 10 + (bcd & 0xf);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_rtc_initialize
+ *
+ * Description:
+ *   Run the RTC at 1Hz, with its interrupts masked. A running calendar is
+ *   left alone.
+ *
+ ****************************************************************************/
+
+void gap8_rtc_initialize(void)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (_read(RTC_CTRL_ADDR) & RTC_CR_STANDBY_MASK)
+    {
+      _write(RTC_IRQ_MASK_ADDR, RTC_IMR_ALARM_MASK | RTC_IMR_TIMER_MASK |
+                                RTC_IMR_CALIBRATION_MASK);
+      _write(RTC_CLKIN_DIV_ADDR, RTC_CLKIN_DIV_VAL(RTC_REF_HZ));
+      _write(RTC_CTRL_ADDR, RTC_CR_STANDBY(0));
+      _write(RTC_CALENDAR_CTRL_ADDR, RTC_CALENDAR_CTRL_STANDBY(0));
+    }
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_rtc_settime
+ *
+ * Description:
+ *   Set the calendar, in BCD: 0x00HHMMSS and 0x00YYMMDD.
+ *
+ ****************************************************************************/
+
+int gap8_rtc_settime(const struct gap8_rtc_time_s *time)
+{
+  uint32_t flags;
+
+  if (time->year < 2000 || time->year > 2099 ||
+      time->month < 1 || time->month > 12 ||
+      time->day < 1 || time->day > 31 ||
+      time->hour > 23 || time->min > 59 || time->sec > 59)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  _write(RTC_CALENDAR_CTRL_ADDR, RTC_CALENDAR_CTRL_STANDBY(1));
+  _write(RTC_CALENDAR_TIME_ADDR, (_to_bcd(time->hour) << 16) |
+                                 (_to_bcd(time->min) << 8) |
+                                 _to_bcd(time->sec));
+  _write(RTC_CALENDAR_DATE_ADDR, (_to_bcd(time->year - 2000) << 16) |
+                                 (_to_bcd(time->month) << 8) |
+                                 _to_bcd(time->day));
+  _write(RTC_CALENDAR_CTRL_ADDR, RTC_CALENDAR_CTRL_STANDBY(0));
+
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_rtc_gettime
+ *
+ * Description:
+ *   Read the calendar. Read the time again if the date rolled over in
+ *   between.
+ *
+ ****************************************************************************/
+
+void gap8_rtc_gettime(struct gap8_rtc_time_s *time)
+{
+  uint32_t flags, hms, ymd;
+
+  flags = up_irq_save();
+
+  do
+    {
+      hms = _read(RTC_CALENDAR_TIME_ADDR);
+      ymd = _read(RTC_CALENDAR_DATE_ADDR);
+    }
+  while (_read(RTC_CALENDAR_TIME_ADDR) < hms);
+
+  up_irq_restore(flags);
+
+  time->year  = 2000 + _from_bcd((ymd >> 16) & 0xff);
+  time->month = _from_bcd((ymd >> 8) & 0xff);
+  time->day   = _from_bcd(ymd & 0xff);
+  time->hour  = _from_bcd((hms >> 16) & 0xff);
+  time->min   = _from_bcd((hms >> 8) & 0xff);
+  time->sec   = _from_bcd(hms & 0xff);
+}
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_start
+ *
+ * Description:
+ *   Raise the RTC interrupt in `seconds`, and every `seconds` after if
+ *   `repeat`.
+ *
+ ****************************************************************************/
+
+int gap8_rtc_countdown_start(uint32_t seconds, bool repeat)
+{
+  uint32_t flags, mask;
+
+  if (seconds == 0)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  _write(RTC_TIMER_CTRL_ADDR, RTC_TIMER_STANDBY(1));
+  _write(RTC_TIMER_INIT_ADDR, seconds);
+  _write(RTC_IRQ_FLAG_ADDR, RTC_IFR_TIMER_MASK);
+  mask = _read(RTC_IRQ_MASK_ADDR);
+  _write(RTC_IRQ_MASK_ADDR, mask & ~RTC_IMR_TIMER_MASK);
+  _write(RTC_TIMER_CTRL_ADDR, RTC_TIMER_MODE(repeat) | RTC_TIMER_STANDBY(0));
+
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_stop
+ *
+ * Description:
+ *   Stop the countdown and mask its interrupt.
+ *
+ ****************************************************************************/
+
+void gap8_rtc_countdown_stop(void)
+{
+  uint32_t flags, mask;
+
+  flags = up_irq_save();
+
+  _write(RTC_TIMER_CTRL_ADDR, RTC_TIMER_STANDBY(1));
+  mask = _read(RTC_IRQ_MASK_ADDR);
+  _write(RTC_IRQ_MASK_ADDR, mask | RTC_IMR_TIMER_MASK);
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_read
+ *
+ * Description:
+ *   Return the seconds left.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_rtc_countdown_read(void)
+{
+  uint32_t flags, value;
+
+  flags = up_irq_save();
+  value = _read(RTC_TIMER_VALUE_ADDR);
+  up_irq_restore(flags);
+
+  return value;
+}
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_expired
+ *
+ * Description:
+ *   Return true if the countdown reached 0 since the last call, and clear
+ *   the flag.
+ *
+ ****************************************************************************/
+
+bool gap8_rtc_countdown_expired(void)
+{
+  uint32_t flags, ifr;
+
+  flags = up_irq_save();
+
+  ifr = _read(RTC_IRQ_FLAG_ADDR);
+  if (ifr & RTC_IFR_TIMER_MASK)
+    {
+      _write(RTC_IRQ_FLAG_ADDR, RTC_IFR_TIMER_MASK);
+    }
+
+  up_irq_restore(flags);
+
+  return (ifr & RTC_IFR_TIMER_MASK) != 0;
+}
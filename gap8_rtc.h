@@ -0,0 +1,117 @@
+/************************************************************************************
+ * RTC driver for GAP8
+ *  The RTC runs from the 32K reference in the always-on domain, and keeps counting
+ *  through deep sleep. Its registers are not memory-mapped: each access goes
+ *  through the REQUEST / DATA pair of the APB bridge, and waits for the bridge to
+ *  flag completion. So keep accesses off hot paths.
+ *
+ *  The input is divided down to 1Hz. The calendar keeps the date and time, and
+ *  the countdown timer raises the RTC interrupt when it reaches 0, which is also
+ *  a wake-up source of the PMU, see gap8_pm.h.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_RTC_H
+#define GAP8_RTC_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+struct gap8_rtc_time_s {
+  uint32_t year;                  /* 2000 to 2099 */
+  uint32_t month;                 /* 1 to 12 */
+  uint32_t day;                   /* 1 to 31 */
+  uint32_t hour;                  /* 0 to 23 */
+  uint32_t min;
+  uint32_t sec;
+};
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_rtc_initialize
+ *
+ * Description:
+ *   Run the RTC at 1Hz, with its interrupts masked. A running calendar is
+ *   left alone, so it is safe to call again after a deep sleep.
+ *
+ ****************************************************************************/
+
+void gap8_rtc_initialize(void);
+
+/****************************************************************************
+ * Name: gap8_rtc_settime
+ *
+ * Description:
+ *   Set the calendar. Return ERROR on an out of range field.
+ *
+ ****************************************************************************/
+
+int gap8_rtc_settime(const struct gap8_rtc_time_s *time);
+
+/****************************************************************************
+ * Name: gap8_rtc_gettime
+ *
+ * Description:
+ *   Read the calendar.
+ *
+ ****************************************************************************/
+
+void gap8_rtc_gettime(struct gap8_rtc_time_s *time);
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_start
+ *
+ * Description:
+ *   Raise the RTC interrupt in `seconds`, and every `seconds` after if
+ *   `repeat`. Return ERROR if `seconds` is 0.
+ *
+ ****************************************************************************/
+
+int gap8_rtc_countdown_start(uint32_t seconds, bool repeat);
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_stop
+ *
+ * Description:
+ *   Stop the countdown and mask its interrupt.
+ *
+ ****************************************************************************/
+
+void gap8_rtc_countdown_stop(void);
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_read
+ *
+ * Description:
+ *   Return the seconds left.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_rtc_countdown_read(void);
+
+/****************************************************************************
+ * Name: gap8_rtc_countdown_expired
+ *
+ * Description:
+ *   Return true if the countdown reached 0 since the last call, and clear
+ *   the flag.
+ *
+ ****************************************************************************/
+
+bool gap8_rtc_countdown_expired(void);
+
+#endif
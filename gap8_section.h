@@ -0,0 +1,65 @@
+/************************************************************************************
+ * Memory placement for GAP8 FC
+ *  FC reaches its private TCDM (16KB) in a single cycle, without contending with
+ *  uDMA traffic on L2. But uDMA can only reach L2. Hence the policy:
+ *
+ *  - Driver control structures, ISR state and hot lookup tables go to FC TCDM:
+ *    GAP8_FC_TCDM_BSS for zero-initialized objects, GAP8_FC_TCDM_DATA for
+ *    initialized ones (copied from L2 at boot), GAP8_FC_TCDM_TINY for the few
+ *    hottest words, which land in the first 2KB of the aliased TCDM and could be
+ *    reached with a single instruction from x0.
+ *  - Anything handed to uDMA (buffers, strings to print) stays in L2, and should
+ *    be marked GAP8_L2_DMA, or GAP8_L2_DMA_DATA if initialized. The FC stack is
+ *    in TCDM, so never pass local buffers to uDMA. The uDMA driver rejects TCDM
+ *    buffers, and gap8_uart_sendbytes() returns the error.
+ *  - State that must survive a retentive deep sleep is marked GAP8_L2_RETAINED.
+ *    It is neither loaded nor cleared at boot, so it reads garbage after a cold
+ *    boot, and must be validated. See gap8_pm.h.
+ *  - Code and constant data stay in L2, behind the FC icache. Functions listed
+ *    in hot_symbols.txt are linked first, GAP8_COLD ones last.
+ *
+ *  Mind the budget: TCDM also hosts the FC stack and the interrupt stack. The
+ *  link fails if TCDM overflows, and placement_report.sh prints what landed
+ *  where after each build.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_SECTION_H
+#define GAP8_SECTION_H
+
+/************************************************************************************
+ * Pre-Processor Declarations
+ ************************************************************************************/
+
+/* Zero-initialized, FC TCDM */
+#define GAP8_FC_TCDM_BSS    __attribute__((section(".fcbss")))
+
+/* Initialized, FC TCDM */
+#define GAP8_FC_TCDM_DATA   __attribute__((section(".fcTcdm")))
+
+/* Initialized, bottom of FC TCDM */
+#define GAP8_FC_TCDM_TINY   __attribute__((section(".l1FcTiny")))
+
+/* Code run once or on error paths, linked at the end of .text so that it
+ * does not share icache lines with hot code. Hot code is listed in
+ * hot_symbols.txt instead. */
+#define GAP8_COLD           __attribute__((cold, noinline, section(".text_cold")))
+
+/* Reachable by uDMA: L2, word aligned. Zero-initialized, or initialized */
+#define GAP8_L2_DMA         __attribute__((section(".bss.l2_dma"), aligned(4)))
+#define GAP8_L2_DMA_DATA    __attribute__((section(".data.l2_dma"), aligned(4)))
+
+/* Kept in L2 across retentive deep sleep, untouched by the boot code */
+#define GAP8_L2_RETAINED    __attribute__((section(".l2_retained"), aligned(4)))
+
+/* Address ranges */
+#define GAP8_L2_START       0x1C000000UL
+#define GAP8_L2_END         0x1C080000UL
+
+/* Return true if uDMA could reach the memory at `addr` */
+#define GAP8_IS_L2(addr) \
+  ((uint32_t)(addr) >= GAP8_L2_START && (uint32_t)(addr) < GAP8_L2_END)
+
+#endif
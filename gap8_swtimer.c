@@ -0,0 +1,225 @@
+/************************************************************************************
+ * Software timers for GAP8 FC
+ *  Hashed timing wheel on the FC timer tick.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_swtimer.h"
+#include "gap8_interrupt.h"
+#include "gap8_tim.h"
+#include "gap8_section.h"
+#include <stddef.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SLOT_MASK   (GAP8_SWTIMER_NR_SLOTS - 1)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Walked on every tick, keep it in FC TCDM */
+static struct gap8_swtimer_s *_wheel[GAP8_SWTIMER_NR_SLOTS] GAP8_FC_TCDM_BSS;
+static uint32_t _now GAP8_FC_TCDM_BSS;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* List helpers. Must be called with IRQ disabled. */
+
+static inline void _link(struct gap8_swtimer_s **head,
+                         struct gap8_swtimer_s *timer)
+{
+  timer->next = *head;
+  if (timer->next)
+    {
+      timer->next->pprev = &timer->next;
+    }
+  timer->pprev = head;
+  *head = timer;
+}
+
+static inline void _unlink(struct gap8_swtimer_s *timer)
+{
+  *timer->pprev = timer->next;
+  if (timer->next)
+    {
+      timer->next->pprev = timer->pprev;
+    }
+  timer->next = NULL;
+  timer->pprev = NULL;
+}
+
+static inline void _arm(struct gap8_swtimer_s *timer, uint32_t ticks)
+{
+  timer->expires = _now + (ticks ? ticks : 1);
+  _link(&_wheel[timer->expires & SLOT_MASK], timer);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_swtimer_initialize
+ *
+ * Description:
+ *   Empty the wheel and drive it from the FC timer callback.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_initialize(void)
+{
+  uint32_t flags;
+  int i;
+
+  flags = up_irq_save();
+
+  for (i = 0; i < GAP8_SWTIMER_NR_SLOTS; i++)
+    {
+      _wheel[i] = NULL;
+    }
+  _now = 0;
+
+  gap8_register_timercallback(gap8_swtimer_tick, NULL);
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_swtimer_init
+ *
+ * Description:
+ *   Initialize a stopped timer calling `func(arg)` on expiry.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_init(struct gap8_swtimer_s *timer,
+                       void (*func)(void *arg), void *arg)
+{
+  timer->next = NULL;
+  timer->pprev = NULL;
+  timer->expires = 0;
+  timer->period = 0;
+  timer->func = func;
+  timer->arg = arg;
+}
+
+/****************************************************************************
+ * Name: gap8_swtimer_start
+ *
+ * Description:
+ *   (Re)start a timer, expiring `ticks` ticks from now, then every `period`
+ *   ticks if not 0.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_start(struct gap8_swtimer_s *timer, uint32_t ticks,
+                        uint32_t period)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (timer->pprev)
+    {
+      _unlink(timer);
+    }
+
+  timer->period = period;
+  _arm(timer, ticks);
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_swtimer_stop
+ *
+ * Description:
+ *   Stop a timer. Nothing happens if it is not pending.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_stop(struct gap8_swtimer_s *timer)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  if (timer->pprev)
+    {
+      _unlink(timer);
+    }
+
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_swtimer_now
+ *
+ * Description:
+ *   Ticks seen by the wheel since gap8_swtimer_initialize().
+ *
+ ****************************************************************************/
+
+uint32_t gap8_swtimer_now(void)
+{
+  return _now;
+}
+
+/****************************************************************************
+ * Name: gap8_swtimer_tick
+ *
+ * Description:
+ *   Advance the wheel by one tick and fire the expired timers.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_tick(void *arg)
+{
+  struct gap8_swtimer_s *expired = NULL;
+  struct gap8_swtimer_s *timer, *next;
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  _now++;
+
+  /* Move the expired timers out of the slot first: periodic ones may land
+   * in the same slot again, and callbacks may stop or restart any timer. */
+
+  for (timer = _wheel[_now & SLOT_MASK]; timer; timer = next)
+    {
+      next = timer->next;
+      if ((int32_t)(timer->expires - _now) <= 0)
+        {
+          _unlink(timer);
+          _link(&expired, timer);
+        }
+    }
+
+  while ((timer = expired) != NULL)
+    {
+      _unlink(timer);
+
+      /* Re-arm before the callback, so that it could stop the timer */
+
+      if (timer->period)
+        {
+          _arm(timer, timer->period);
+        }
+
+      timer->func(timer->arg);
+    }
+
+  up_irq_restore(flags);
+}
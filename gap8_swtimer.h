@@ -0,0 +1,143 @@
+/************************************************************************************
+ * Software timers for GAP8 FC
+ *  Any number of one-shot and periodic timers on the single FC timer callback,
+ *  kept in a hashed timing wheel: a timer expiring at tick T is linked in slot
+ *  T % GAP8_SWTIMER_NR_SLOTS. Each tick walks one slot and fires the timers whose
+ *  expiry has come; the others are one or more wheel turns away. Start and stop
+ *  are O(1), a tick costs the length of one slot.
+ *
+ *  The wheel advances once per timer tick, so run the timer in periodic or
+ *  cascaded mode. Callbacks run in the timer ISR: keep them short, or queue a
+ *  work. They may start or stop any timer, including their own.
+ *
+ *    static struct gap8_swtimer_s rto;
+ *
+ *    gap8_timer_initialize(freq, 100);
+ *    gap8_swtimer_initialize();
+ *    gap8_swtimer_init(&rto, on_retransmit, conn);
+ *    gap8_swtimer_start(&rto, 20, 0);      // once, in 200ms
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_SWTIMER_H
+#define GAP8_SWTIMER_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/************************************************************************************
+ * Pre-Processor Declarations
+ ************************************************************************************/
+
+/* Slots in the wheel, power of 2. More slots, shorter walk per tick. */
+#define GAP8_SWTIMER_NR_SLOTS   256
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+struct gap8_swtimer_s {
+  struct gap8_swtimer_s *next;
+  struct gap8_swtimer_s **pprev;    /* NULL if not pending         */
+  uint32_t expires;                 /* absolute tick               */
+  uint32_t period;                  /* ticks, 0 for one-shot       */
+  void (*func)(void *arg);
+  void *arg;
+};
+
+/************************************************************************************
+ * Inline Functions
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_swtimer_pending
+ *
+ * Description:
+ *   Return true if the timer is started and has not expired yet, or is
+ *   periodic.
+ *
+ ****************************************************************************/
+
+static inline bool gap8_swtimer_pending(const struct gap8_swtimer_s *timer)
+{
+  return timer->pprev != NULL;
+}
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_swtimer_initialize
+ *
+ * Description:
+ *   Empty the wheel and drive it from the FC timer callback. Initialize
+ *   the FC timer first.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_initialize(void);
+
+/****************************************************************************
+ * Name: gap8_swtimer_init
+ *
+ * Description:
+ *   Initialize a stopped timer calling `func(arg)` on expiry.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_init(struct gap8_swtimer_s *timer,
+                       void (*func)(void *arg), void *arg);
+
+/****************************************************************************
+ * Name: gap8_swtimer_start
+ *
+ * Description:
+ *   (Re)start a timer, expiring `ticks` ticks from now (at least 1), then
+ *   every `period` ticks if not 0.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_start(struct gap8_swtimer_s *timer, uint32_t ticks,
+                        uint32_t period);
+
+/****************************************************************************
+ * Name: gap8_swtimer_stop
+ *
+ * Description:
+ *   Stop a timer. Nothing happens if it is not pending.
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_stop(struct gap8_swtimer_s *timer);
+
+/****************************************************************************
+ * Name: gap8_swtimer_now
+ *
+ * Description:
+ *   Ticks seen by the wheel since gap8_swtimer_initialize().
+ *
+ ****************************************************************************/
+
+uint32_t gap8_swtimer_now(void);
+
+/****************************************************************************
+ * Name: gap8_swtimer_tick
+ *
+ * Description:
+ *   Advance the wheel by one tick and fire the expired timers. Registered
+ *   as the FC timer callback by gap8_swtimer_initialize().
+ *
+ ****************************************************************************/
+
+void gap8_swtimer_tick(void *arg);
+
+#endif
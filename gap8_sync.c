@@ -0,0 +1,436 @@
+/************************************************************************************
+ * Lightweight synchronization for GAP8 FC
+ *  ISRs hand over work to the main flow through counting semaphores, completions
+ *  and single-producer/single-consumer queues. Each object owns one of the 8 FC
+ *  software events, so the signaling ISR wakes up exactly the waiter sleeping on
+ *  it, instead of every sleeper in the system.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_sync.h"
+#include "gap8_interrupt.h"
+#include "gap8_section.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Keep the compiler from moving memory accesses across it. FC is single
+ * issue and in order, so that's all we need between data and index. */
+#define COMPILER_BARRIER()  asm volatile ("" : : : "memory")
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Bitmap of allocated FC software events */
+static uint32_t _used_events GAP8_FC_TCDM_BSS;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline void _signal(uint32_t event)
+{
+  EU_SW_EVNT_TRIG->TRIGGER_SET[event] = 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_sync_alloc_event
+ *
+ * Description:
+ *   Allocate a free FC software event. Return the event number, or ERROR
+ *   if all of them are in use.
+ *
+ ****************************************************************************/
+
+int gap8_sync_alloc_event(void)
+{
+  uint32_t flags;
+  int event;
+
+  flags = up_irq_save();
+  for (event = 0; event < GAP8_SYNC_NR_EVENTS; event++)
+    {
+      if ((_used_events & (1L << event)) == 0)
+        {
+          _used_events |= (1L << event);
+          break;
+        }
+    }
+  up_irq_restore(flags);
+
+  if (event == GAP8_SYNC_NR_EVENTS)
+    {
+      return ERROR;
+    }
+
+  /* Drop any stale event left by a previous owner */
+
+  FCEU->BUFFER_CLEAR = (1L << event);
+
+  return event;
+}
+
+/****************************************************************************
+ * Name: gap8_sync_free_event
+ *
+ * Description:
+ *   Return an FC software event to the pool.
+ *
+ ****************************************************************************/
+
+void gap8_sync_free_event(uint32_t event)
+{
+  uint32_t flags;
+
+  if (event >= GAP8_SYNC_NR_EVENTS)
+    {
+      return;
+    }
+
+  flags = up_irq_save();
+  _used_events &= ~(1L << event);
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_sem_init
+ *
+ * Description:
+ *   Initialize a semaphore with `count` tokens and bind it to its own
+ *   software event. Return ERROR if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_sem_init(struct gap8_sem_s *sem, int32_t count)
+{
+  int event = gap8_sync_alloc_event();
+
+  if (event < 0)
+    {
+      return ERROR;
+    }
+
+  sem->count = count;
+  sem->event = event;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_sem_destroy
+ *
+ * Description:
+ *   Release the software event held by the semaphore.
+ *
+ ****************************************************************************/
+
+void gap8_sem_destroy(struct gap8_sem_s *sem)
+{
+  gap8_sync_free_event(sem->event);
+}
+
+/****************************************************************************
+ * Name: gap8_sem_post
+ *
+ * Description:
+ *   Give one token and wake up the waiter. Safe to call from ISR.
+ *
+ ****************************************************************************/
+
+void gap8_sem_post(struct gap8_sem_s *sem)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+  sem->count++;
+  up_irq_restore(flags);
+
+  _signal(sem->event);
+}
+
+/****************************************************************************
+ * Name: gap8_sem_trywait
+ *
+ * Description:
+ *   Take one token without blocking. Return OK on success, or ERROR if the
+ *   semaphore is empty.
+ *
+ ****************************************************************************/
+
+int gap8_sem_trywait(struct gap8_sem_s *sem)
+{
+  uint32_t flags;
+  int ret = ERROR;
+
+  flags = up_irq_save();
+  if (sem->count > 0)
+    {
+      sem->count--;
+      ret = OK;
+    }
+  up_irq_restore(flags);
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: gap8_sem_wait
+ *
+ * Description:
+ *   Take one token, sleeping on the semaphore's event until one is posted.
+ *   Must not be called from ISR.
+ *
+ ****************************************************************************/
+
+void gap8_sem_wait(struct gap8_sem_s *sem)
+{
+  while (gap8_sem_trywait(sem) != OK)
+    {
+      gap8_sleep_wait_sw_evnt(1L << sem->event);
+    }
+}
+
+/****************************************************************************
+ * Name: gap8_completion_init
+ *
+ * Description:
+ *   Initialize a completion and bind it to its own software event. Return
+ *   ERROR if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_completion_init(struct gap8_completion_s *comp)
+{
+  int event = gap8_sync_alloc_event();
+
+  if (event < 0)
+    {
+      return ERROR;
+    }
+
+  comp->done = 0;
+  comp->event = event;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_completion_destroy
+ *
+ * Description:
+ *   Release the software event held by the completion.
+ *
+ ****************************************************************************/
+
+void gap8_completion_destroy(struct gap8_completion_s *comp)
+{
+  gap8_sync_free_event(comp->event);
+}
+
+/****************************************************************************
+ * Name: gap8_completion_reinit
+ *
+ * Description:
+ *   Forget any completion signaled so far. Call it before starting the job
+ *   that is going to signal it.
+ *
+ ****************************************************************************/
+
+void gap8_completion_reinit(struct gap8_completion_s *comp)
+{
+  comp->done = 0;
+}
+
+/****************************************************************************
+ * Name: gap8_complete
+ *
+ * Description:
+ *   Signal the completion and wake up the waiter. Safe to call from ISR.
+ *
+ ****************************************************************************/
+
+void gap8_complete(struct gap8_completion_s *comp)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+  comp->done++;
+  up_irq_restore(flags);
+
+  _signal(comp->event);
+}
+
+/****************************************************************************
+ * Name: gap8_completion_done
+ *
+ * Description:
+ *   Return true if the completion has been signaled, without consuming it.
+ *
+ ****************************************************************************/
+
+bool gap8_completion_done(struct gap8_completion_s *comp)
+{
+  return comp->done != 0;
+}
+
+/****************************************************************************
+ * Name: gap8_wait_for_completion
+ *
+ * Description:
+ *   Sleep until the completion is signaled, and consume it.
+ *
+ ****************************************************************************/
+
+void gap8_wait_for_completion(struct gap8_completion_s *comp)
+{
+  uint32_t flags;
+
+  for (; ; )
+    {
+      flags = up_irq_save();
+      if (comp->done)
+        {
+          comp->done--;
+          up_irq_restore(flags);
+          return;
+        }
+      up_irq_restore(flags);
+
+      gap8_sleep_wait_sw_evnt(1L << comp->event);
+    }
+}
+
+/****************************************************************************
+ * Name: gap8_spsc_init
+ *
+ * Description:
+ *   Initialize a queue over `buff` of `depth` items. `depth` must be a
+ *   power of 2. Return ERROR on bad depth or if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_spsc_init(struct gap8_spsc_s *q, uint32_t *buff, uint32_t depth)
+{
+  int event;
+
+  if (buff == 0 || depth == 0 || (depth & (depth - 1)) != 0)
+    {
+      return ERROR;
+    }
+
+  event = gap8_sync_alloc_event();
+  if (event < 0)
+    {
+      return ERROR;
+    }
+
+  q->buff = buff;
+  q->mask = depth - 1;
+  q->head = 0;
+  q->tail = 0;
+  q->event = event;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_spsc_destroy
+ *
+ * Description:
+ *   Release the software event held by the queue.
+ *
+ ****************************************************************************/
+
+void gap8_spsc_destroy(struct gap8_spsc_s *q)
+{
+  gap8_sync_free_event(q->event);
+}
+
+/****************************************************************************
+ * Name: gap8_spsc_push
+ *
+ * Description:
+ *   Producer side. Queue one item and wake up the consumer. Return ERROR if
+ *   the queue is full. Safe to call from ISR.
+ *
+ ****************************************************************************/
+
+int gap8_spsc_push(struct gap8_spsc_s *q, uint32_t item)
+{
+  uint32_t head = q->head;
+
+  if (head - q->tail > q->mask)
+    {
+      return ERROR;
+    }
+
+  /* Publish the data before the index */
+
+  q->buff[head & q->mask] = item;
+  COMPILER_BARRIER();
+  q->head = head + 1;
+
+  _signal(q->event);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_spsc_pop
+ *
+ * Description:
+ *   Consumer side. Dequeue one item without blocking. Return ERROR if the
+ *   queue is empty.
+ *
+ ****************************************************************************/
+
+int gap8_spsc_pop(struct gap8_spsc_s *q, uint32_t *item)
+{
+  uint32_t tail = q->tail;
+
+  if (tail == q->head)
+    {
+      return ERROR;
+    }
+
+  /* Fetch the data before releasing the slot */
+
+  COMPILER_BARRIER();
+  *item = q->buff[tail & q->mask];
+  COMPILER_BARRIER();
+  q->tail = tail + 1;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_spsc_pop_wait
+ *
+ * Description:
+ *   Consumer side. Sleep until an item is available and dequeue it.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_spsc_pop_wait(struct gap8_spsc_s *q)
+{
+  uint32_t item;
+
+  while (gap8_spsc_pop(q, &item) != OK)
+    {
+      gap8_sleep_wait_sw_evnt(1L << q->event);
+    }
+
+  return item;
+}
@@ -0,0 +1,269 @@
+/************************************************************************************
+ * Lightweight synchronization for GAP8 FC
+ *  ISRs hand over work to the main flow through counting semaphores, completions
+ *  and single-producer/single-consumer queues. Each object owns one of the 8 FC
+ *  software events, so the signaling ISR wakes up exactly the waiter sleeping on
+ *  it, instead of every sleeper in the system.
+ *
+ *  The event unit buffers a triggered event until it is waited on. So a signal
+ *  that arrives between checking the count and going to sleep is never lost; the
+ *  sleep simply returns at once.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_SYNC_H
+#define GAP8_SYNC_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/************************************************************************************
+ * Pre-Processor Declarations
+ ************************************************************************************/
+
+/* Number of FC software events, shared by all the sync objects */
+#define GAP8_SYNC_NR_EVENTS   8
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+/* Counting semaphore */
+struct gap8_sem_s {
+  volatile int32_t count;
+  uint32_t event;                 /* FC software event of the waiter */
+};
+
+/* One-shot (or counted) completion of an asynchronous job */
+struct gap8_completion_s {
+  volatile uint32_t done;
+  uint32_t event;                 /* FC software event of the waiter */
+};
+
+/*
+ * Wait-free single-producer/single-consumer queue of 32-bit items.
+ * `head` is only written by the producer and `tail` only by the consumer, so
+ * neither side needs to mask interrupts. Depth must be a power of 2.
+ **/
+struct gap8_spsc_s {
+  uint32_t *buff;
+  uint32_t mask;                  /* depth - 1 */
+  volatile uint32_t head;         /* free running write index */
+  volatile uint32_t tail;         /* free running read index  */
+  uint32_t event;                 /* FC software event of the consumer */
+};
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_sync_alloc_event
+ *
+ * Description:
+ *   Allocate a free FC software event. Return the event number, or ERROR
+ *   if all of them are in use.
+ *
+ ****************************************************************************/
+
+int gap8_sync_alloc_event(void);
+
+/****************************************************************************
+ * Name: gap8_sync_free_event
+ *
+ * Description:
+ *   Return an FC software event to the pool.
+ *
+ ****************************************************************************/
+
+void gap8_sync_free_event(uint32_t event);
+
+/****************************************************************************
+ * Name: gap8_sem_init
+ *
+ * Description:
+ *   Initialize a semaphore with `count` tokens and bind it to its own
+ *   software event. Return ERROR if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_sem_init(struct gap8_sem_s *sem, int32_t count);
+
+/****************************************************************************
+ * Name: gap8_sem_destroy
+ *
+ * Description:
+ *   Release the software event held by the semaphore.
+ *
+ ****************************************************************************/
+
+void gap8_sem_destroy(struct gap8_sem_s *sem);
+
+/****************************************************************************
+ * Name: gap8_sem_post
+ *
+ * Description:
+ *   Give one token and wake up the waiter. Safe to call from ISR.
+ *
+ ****************************************************************************/
+
+void gap8_sem_post(struct gap8_sem_s *sem);
+
+/****************************************************************************
+ * Name: gap8_sem_trywait
+ *
+ * Description:
+ *   Take one token without blocking. Return OK on success, or ERROR if the
+ *   semaphore is empty.
+ *
+ ****************************************************************************/
+
+int gap8_sem_trywait(struct gap8_sem_s *sem);
+
+/****************************************************************************
+ * Name: gap8_sem_wait
+ *
+ * Description:
+ *   Take one token, sleeping on the semaphore's event until one is posted.
+ *   Must not be called from ISR.
+ *
+ ****************************************************************************/
+
+void gap8_sem_wait(struct gap8_sem_s *sem);
+
+/****************************************************************************
+ * Name: gap8_completion_init
+ *
+ * Description:
+ *   Initialize a completion and bind it to its own software event. Return
+ *   ERROR if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_completion_init(struct gap8_completion_s *comp);
+
+/****************************************************************************
+ * Name: gap8_completion_destroy
+ *
+ * Description:
+ *   Release the software event held by the completion.
+ *
+ ****************************************************************************/
+
+void gap8_completion_destroy(struct gap8_completion_s *comp);
+
+/****************************************************************************
+ * Name: gap8_completion_reinit
+ *
+ * Description:
+ *   Forget any completion signaled so far. Call it before starting the job
+ *   that is going to signal it.
+ *
+ ****************************************************************************/
+
+void gap8_completion_reinit(struct gap8_completion_s *comp);
+
+/****************************************************************************
+ * Name: gap8_complete
+ *
+ * Description:
+ *   Signal the completion and wake up the waiter. Safe to call from ISR.
+ *
+ ****************************************************************************/
+
+void gap8_complete(struct gap8_completion_s *comp);
+
+/****************************************************************************
+ * Name: gap8_completion_done
+ *
+ * Description:
+ *   Return true if the completion has been signaled, without consuming it.
+ *
+ ****************************************************************************/
+
+bool gap8_completion_done(struct gap8_completion_s *comp);
+
+/****************************************************************************
+ * Name: gap8_wait_for_completion
+ *
+ * Description:
+ *   Sleep until the completion is signaled, and consume it.
+ *
+ ****************************************************************************/
+
+void gap8_wait_for_completion(struct gap8_completion_s *comp);
+
+/****************************************************************************
+ * Name: gap8_spsc_init
+ *
+ * Description:
+ *   Initialize a queue over `buff` of `depth` items. `depth` must be a
+ *   power of 2. Return ERROR on bad depth or if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_spsc_init(struct gap8_spsc_s *q, uint32_t *buff, uint32_t depth);
+
+/****************************************************************************
+ * Name: gap8_spsc_destroy
+ *
+ * Description:
+ *   Release the software event held by the queue.
+ *
+ ****************************************************************************/
+
+void gap8_spsc_destroy(struct gap8_spsc_s *q);
+
+/****************************************************************************
+ * Name: gap8_spsc_push
+ *
+ * Description:
+ *   Producer side. Queue one item and wake up the consumer. Return ERROR if
+ *   the queue is full. Safe to call from ISR.
+ *
+ ****************************************************************************/
+
+int gap8_spsc_push(struct gap8_spsc_s *q, uint32_t item);
+
+/****************************************************************************
+ * Name: gap8_spsc_pop
+ *
+ * Description:
+ *   Consumer side. Dequeue one item without blocking. Return ERROR if the
+ *   queue is empty.
+ *
+ ****************************************************************************/
+
+int gap8_spsc_pop(struct gap8_spsc_s *q, uint32_t *item);
+
+/****************************************************************************
+ * Name: gap8_spsc_pop_wait
+ *
+ * Description:
+ *   Consumer side. Sleep until an item is available and dequeue it.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_spsc_pop_wait(struct gap8_spsc_s *q);
+
+/****************************************************************************
+ * Name: gap8_spsc_count
+ *
+ * Description:
+ *   Number of items in the queue.
+ *
+ ****************************************************************************/
+
+static inline uint32_t gap8_spsc_count(struct gap8_spsc_s *q)
+{
+  return q->head - q->tail;
+}
+
+#endif
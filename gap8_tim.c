@@ -16,6 +16,37 @@
 
 #include "gap8_tim.h"
 #include "gap8_interrupt.h"
+#include "gap8_section.h"
+#include "gap8_fll.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* No deadline pending */
+#define NO_DEADLINE       UINT64_MAX
+
+/* Longest one-shot interval. The 1MHz counter wraps after ~71 minutes, so
+ * wake up at least every ~35 minutes to account the elapsed time. */
+#define MAX_ONESHOT_US    (1UL << 31)
+
+/* Shortest one-shot interval, so that the compare value is not already
+ * behind the counter when written. */
+#define MIN_ONESHOT_US    2
+
+/* Shortest distance to the next compare value in cascaded mode, in cycles */
+#define MIN_CASCADE_CYCLES  64
+
+/* Shortest distance to the next compare value on the high half, in cycles */
+#define MIN_HI_CYCLES     32
+
+/* Prescaler field of CFG_REG_LO */
+#define TIM_PRESC_MASK    (0xffL << 8)
+
+/* Timer modes */
+#define TIM_MODE_PERIODIC 0   /* 32-bit, 1MHz, reset on compare     */
+#define TIM_MODE_TICKLESS 1   /* 32-bit, 1MHz, one-shot compare     */
+#define TIM_MODE_CASCADE  2   /* 64-bit, FLL rate, compare re-armed */
 
 /****************************************************************************
  * Private Data
@@ -28,12 +59,173 @@ struct gap8_tim_instance {
   /* callback function */
   void (*on_timer)(void*arg);
   void *arg;
-} fc_basic_timer = {
+  uint32_t mode;
+  /* tickless mode */
+  uint32_t last_count;    /* VALUE_LO at last accounting */
+  uint64_t elapsed_us;    /* time since tickless init    */
+  uint64_t deadline_us;   /* next one-shot, or NO_DEADLINE */
+  /* cascaded mode */
+  uint32_t period;        /* cycles per tick, 0 for no tick */
+  uint64_t next_cmp;      /* 64-bit compare value           */
+  uint64_t base_cycles;   /* counter at the last clock change */
+  uint64_t base_us;       /* time at the last clock change    */
+} fc_basic_timer GAP8_FC_TCDM_DATA = {
   .reg = BASIC_TIM,
   .core_clock = 50000000,
   .tick_per_second = 10,
+  .mode = TIM_MODE_PERIODIC,
+  .deadline_us = NO_DEADLINE,
 };
 
+/* Independent high half, for precise one-shot events */
+
+static struct gap8_tim_hi_s {
+  uint32_t core_clock;    /* 0 if not initialized     */
+  bool armed;             /* a one-shot is pending     */
+  void (*on_timer)(void *arg);
+  void *arg;
+} _timer_hi GAP8_FC_TCDM_BSS;
+
+static void _clock_postchange(uint32_t old_hz, uint32_t new_hz, void *arg);
+
+/* Both halves run from the FLL */
+
+static struct gap8_fll_notifier_s _clock_nb = {
+  .post_change = _clock_postchange,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Fold the counter into elapsed_us. Must be called with IRQ disabled. */
+
+static uint64_t _account(void)
+{
+  uint32_t now = fc_basic_timer.reg->VALUE_LO;
+
+  fc_basic_timer.elapsed_us += (uint32_t)(now - fc_basic_timer.last_count);
+  fc_basic_timer.last_count = now;
+
+  return fc_basic_timer.elapsed_us;
+}
+
+/* Program CMP_LO for the next deadline. Must be called with IRQ disabled. */
+
+static void _program_oneshot(uint64_t now_us)
+{
+  uint64_t delay = MAX_ONESHOT_US;
+  uint32_t cmpval;
+
+  if (fc_basic_timer.deadline_us != NO_DEADLINE)
+    {
+      delay = fc_basic_timer.deadline_us > now_us ?
+              fc_basic_timer.deadline_us - now_us : 0;
+      if (delay > MAX_ONESHOT_US)
+        {
+          delay = MAX_ONESHOT_US;
+        }
+    }
+
+  if (delay < MIN_ONESHOT_US)
+    {
+      delay = MIN_ONESHOT_US;
+    }
+
+  /* The comparator only fires on equality. Make sure the counter has not
+   * gone past it while writing. */
+
+  do
+    {
+      cmpval = fc_basic_timer.reg->VALUE_LO + (uint32_t)delay;
+      fc_basic_timer.reg->CMP_LO = cmpval;
+      delay = MIN_ONESHOT_US;
+    }
+  while ((int32_t)(fc_basic_timer.reg->VALUE_LO - cmpval) >= 0);
+}
+
+/* Program the 64-bit compare value for the next tick in cascaded mode.
+ * Must be called with IRQ disabled. */
+
+static void _program_cascade(void)
+{
+  uint64_t now = gap8_clock_read();
+
+  fc_basic_timer.next_cmp += fc_basic_timer.period;
+
+  /* Skip the ticks missed, rather than firing them back to back */
+
+  if ((int64_t)(fc_basic_timer.next_cmp - now) < MIN_CASCADE_CYCLES)
+    {
+      fc_basic_timer.next_cmp = now + fc_basic_timer.period;
+    }
+
+  fc_basic_timer.reg->CMP_HI = (uint32_t)(fc_basic_timer.next_cmp >> 32);
+  fc_basic_timer.reg->CMP_LO = (uint32_t)fc_basic_timer.next_cmp;
+}
+
+/* Microseconds since cascade initialization, at counter value `now` */
+
+static uint64_t _cascade_us(uint64_t now)
+{
+  return fc_basic_timer.base_us +
+         gap8_clock_to_us(now - fc_basic_timer.base_cycles);
+}
+
+/* Recompute the dividers and compare values for the new rate */
+
+static void _clock_postchange(uint32_t old_hz, uint32_t new_hz, void *arg)
+{
+  uint32_t prescaler = (new_hz / 1000000) & 0xff;
+  uint64_t now;
+  int32_t left;
+
+  if (fc_basic_timer.mode == TIM_MODE_CASCADE)
+    {
+      /* The counter keeps its value, only its rate changes. Fold the time
+       * counted at the old rate. The few us the FLL takes to lock are
+       * counted at the new rate. */
+
+      now = gap8_clock_read();
+      fc_basic_timer.base_us = _cascade_us(now);
+      fc_basic_timer.base_cycles = now;
+      fc_basic_timer.core_clock = new_hz;
+
+      if (fc_basic_timer.period)
+        {
+          fc_basic_timer.period = new_hz / fc_basic_timer.tick_per_second;
+          fc_basic_timer.next_cmp = now;
+          _program_cascade();
+        }
+    }
+  else
+    {
+      /* Keep the 1MHz count, without resetting the counter */
+
+      fc_basic_timer.reg->CFG_REG_LO =
+        (fc_basic_timer.reg->CFG_REG_LO & ~TIM_PRESC_MASK) | (prescaler << 8);
+      fc_basic_timer.core_clock = new_hz;
+    }
+
+  if (_timer_hi.core_clock)
+    {
+      /* Scale what is left of the pending one-shot */
+
+      left = (int32_t)(fc_basic_timer.reg->CMP_HI - fc_basic_timer.reg->VALUE_HI);
+      if (_timer_hi.armed && left > 0)
+        {
+          left = (int32_t)(((uint64_t)left * new_hz) / old_hz);
+          if (left < MIN_HI_CYCLES)
+            {
+              left = MIN_HI_CYCLES;
+            }
+          fc_basic_timer.reg->CMP_HI = fc_basic_timer.reg->VALUE_HI + left;
+        }
+
+      _timer_hi.core_clock = new_hz;
+    }
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -64,10 +256,442 @@ void gap8_timer_initialize(uint32_t source_clock, uint32_t tick_per_second)
 
   fc_basic_timer.core_clock = source_clock;
   fc_basic_timer.tick_per_second = tick_per_second;
+  fc_basic_timer.mode = TIM_MODE_PERIODIC;
 
+  gap8_fll_register_notifier(&_clock_nb);
   up_enable_irq(GAP8_IRQ_FC_TIMER_LO);
 }
 
+/****************************************************************************
+ * Name: gap8_timer_tickless_initialize
+ *
+ * Description:
+ *   Initialize the timer in tickless mode. The counter runs freely at 1MHz
+ *   and CMP_LO is reprogrammed as a one-shot for the next deadline only.
+ *   Ticks are still counted in `tick_per_second`.
+ *
+ ****************************************************************************/
+
+void gap8_timer_tickless_initialize(uint32_t source_clock,
+                                    uint32_t tick_per_second)
+{
+  uint32_t prescaler = (source_clock / 1000000) & 0xff;
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  /* Continuous mode: the counter is not reset on compare match */
+
+  fc_basic_timer.reg->CFG_REG_LO = (prescaler << 8) |
+    BASIC_TIM_CLKSRC_FLL | BASIC_TIM_PRESC_ENABLE | BASIC_TIM_MODE_CONT |
+    BASIC_TIM_IRQ_ENABLE | BASIC_TIM_RESET | BASIC_TIM_ENABLE;
+  fc_basic_timer.reg->VALUE_LO = 0;
+
+  fc_basic_timer.core_clock = source_clock;
+  fc_basic_timer.tick_per_second = tick_per_second;
+  fc_basic_timer.mode = TIM_MODE_TICKLESS;
+  fc_basic_timer.last_count = 0;
+  fc_basic_timer.elapsed_us = 0;
+  fc_basic_timer.deadline_us = NO_DEADLINE;
+
+  _program_oneshot(0);
+  gap8_fll_register_notifier(&_clock_nb);
+
+  up_irq_restore(flags);
+
+  up_enable_irq(GAP8_IRQ_FC_TIMER_LO);
+}
+
+/****************************************************************************
+ * Name: gap8_timer_cascade_initialize
+ *
+ * Description:
+ *   Initialize the timer in cascaded mode: both halves form a single 64-bit
+ *   counter running at the FLL rate, which never wraps in practice. CMP_HI
+ *   and CMP_LO form a 64-bit compare value, advanced by one tick period on
+ *   each IRQ, so that the counter is never reset.
+ *
+ ****************************************************************************/
+
+void gap8_timer_cascade_initialize(uint32_t source_clock,
+                                   uint32_t tick_per_second)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+
+  /* The high half is part of the counter now */
+
+  up_disable_irq(GAP8_IRQ_FC_TIMER_HI);
+  _timer_hi.core_clock = 0;
+  _timer_hi.armed = false;
+
+  fc_basic_timer.reg->CFG_REG_HI = 0;
+  fc_basic_timer.reg->CFG_REG_LO = BASIC_TIM_CASC_ENABLE |
+    BASIC_TIM_CLKSRC_FLL | BASIC_TIM_PRESC_DISABLE | BASIC_TIM_MODE_CONT |
+    (tick_per_second ? BASIC_TIM_IRQ_ENABLE : BASIC_TIM_IRQ_DISABLE) |
+    BASIC_TIM_RESET | BASIC_TIM_ENABLE;
+
+  fc_basic_timer.core_clock = source_clock;
+  fc_basic_timer.tick_per_second = tick_per_second;
+  fc_basic_timer.mode = TIM_MODE_CASCADE;
+  fc_basic_timer.period = tick_per_second ? source_clock / tick_per_second : 0;
+  fc_basic_timer.next_cmp = 0;
+  fc_basic_timer.base_cycles = 0;
+  fc_basic_timer.base_us = 0;
+
+  if (fc_basic_timer.period)
+    {
+      _program_cascade();
+    }
+  gap8_fll_register_notifier(&_clock_nb);
+
+  up_irq_restore(flags);
+
+  if (fc_basic_timer.period)
+    {
+      up_enable_irq(GAP8_IRQ_FC_TIMER_LO);
+    }
+  else
+    {
+      up_disable_irq(GAP8_IRQ_FC_TIMER_LO);
+    }
+}
+
+/****************************************************************************
+ * Name: gap8_clock_hz
+ *
+ * Description:
+ *   Rate of gap8_clock_read() in Hz, or 0 if the timer is not cascaded.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_clock_hz(void)
+{
+  return fc_basic_timer.mode == TIM_MODE_CASCADE ?
+         fc_basic_timer.core_clock : 0;
+}
+
+/****************************************************************************
+ * Name: gap8_clock_to_ns
+ *
+ * Description:
+ *   Convert cycles of gap8_clock_read() to nanoseconds. Split in seconds
+ *   and remainder, so that it does not overflow.
+ *
+ ****************************************************************************/
+
+uint64_t gap8_clock_to_ns(uint64_t cycles)
+{
+  uint32_t hz = fc_basic_timer.core_clock;
+  uint64_t sec = cycles / hz;
+  uint32_t rem = (uint32_t)(cycles - sec * hz);
+
+  return sec * 1000000000ULL + ((uint64_t)rem * 1000000000ULL) / hz;
+}
+
+/****************************************************************************
+ * Name: gap8_clock_to_us
+ *
+ * Description:
+ *   Convert cycles of gap8_clock_read() to microseconds.
+ *
+ ****************************************************************************/
+
+uint64_t gap8_clock_to_us(uint64_t cycles)
+{
+  uint32_t hz = fc_basic_timer.core_clock;
+  uint64_t sec = cycles / hz;
+  uint32_t rem = (uint32_t)(cycles - sec * hz);
+
+  return sec * 1000000 + ((uint64_t)rem * 1000000) / hz;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_initialize
+ *
+ * Description:
+ *   Start the high half as an independent channel: a free running 32-bit
+ *   counter at the FLL rate, with its own IRQ for one-shot events.
+ *   Return ERROR in cascaded mode, where the high half is taken. The boot
+ *   profiler's 32kHz count is gone from then on.
+ *
+ ****************************************************************************/
+
+int gap8_timer_hi_initialize(uint32_t source_clock)
+{
+  uint32_t flags;
+
+  if (fc_basic_timer.mode == TIM_MODE_CASCADE)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  fc_basic_timer.reg->CFG_REG_HI = BASIC_TIM_CLKSRC_FLL |
+    BASIC_TIM_PRESC_DISABLE | BASIC_TIM_MODE_CONT | BASIC_TIM_IRQ_ENABLE |
+    BASIC_TIM_RESET | BASIC_TIM_ENABLE;
+
+  _timer_hi.core_clock = source_clock;
+  _timer_hi.armed = false;
+  gap8_fll_register_notifier(&_clock_nb);
+
+  up_irq_restore(flags);
+
+  up_enable_irq(GAP8_IRQ_FC_TIMER_HI);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_now
+ *
+ * Description:
+ *   Current count of the high half, in cycles.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_hi_now(void)
+{
+  return fc_basic_timer.reg->VALUE_HI;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_us_to_cycles
+ *
+ * Description:
+ *   Convert microseconds to cycles of the high half.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_hi_us_to_cycles(uint32_t us)
+{
+  return (uint32_t)(((uint64_t)us * _timer_hi.core_clock) / 1000000);
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_oneshot_at
+ *
+ * Description:
+ *   Call `on_timer(arg)` once when the high half reaches `when`, replacing
+ *   a pending one-shot of the same `on_timer`. Return ERROR if another
+ *   `on_timer` owns it, if `when` is already too close or behind, or the
+ *   channel is not initialized.
+ *
+ ****************************************************************************/
+
+int gap8_timer_hi_oneshot_at(uint32_t when, void (*on_timer)(void *arg),
+                             void *arg)
+{
+  uint32_t flags;
+  int ret = OK;
+
+  if (_timer_hi.core_clock == 0)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  if (_timer_hi.armed && _timer_hi.on_timer != on_timer)
+    {
+      up_irq_restore(flags);
+      return ERROR;
+    }
+
+  _timer_hi.on_timer = on_timer;
+  _timer_hi.arg = arg;
+  _timer_hi.armed = true;
+  fc_basic_timer.reg->CMP_HI = when;
+
+  /* The comparator only fires on equality */
+
+  if ((int32_t)(when - fc_basic_timer.reg->VALUE_HI) < MIN_HI_CYCLES)
+    {
+      _timer_hi.armed = false;
+      ret = ERROR;
+    }
+
+  up_irq_restore(flags);
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_oneshot
+ *
+ * Description:
+ *   Call `on_timer(arg)` once, `us` microseconds from now. Delays too short
+ *   to program are rounded up. Return ERROR if the channel is not
+ *   initialized.
+ *
+ ****************************************************************************/
+
+int gap8_timer_hi_oneshot(uint32_t us, void (*on_timer)(void *arg), void *arg)
+{
+  uint32_t delay = gap8_timer_hi_us_to_cycles(us);
+
+  if (delay < 2 * MIN_HI_CYCLES)
+    {
+      delay = 2 * MIN_HI_CYCLES;
+    }
+
+  return gap8_timer_hi_oneshot_at(fc_basic_timer.reg->VALUE_HI + delay,
+                                  on_timer, arg);
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_cancel
+ *
+ * Description:
+ *   Cancel the pending one-shot, if `on_timer` owns it.
+ *
+ ****************************************************************************/
+
+void gap8_timer_hi_cancel(void (*on_timer)(void *arg))
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+  if (_timer_hi.on_timer == on_timer)
+    {
+      _timer_hi.armed = false;
+    }
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_pending
+ *
+ * Description:
+ *   Return true if a one-shot of `on_timer` is pending.
+ *
+ ****************************************************************************/
+
+bool gap8_timer_hi_pending(void (*on_timer)(void *arg))
+{
+  return _timer_hi.armed && _timer_hi.on_timer == on_timer;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_hi_isr
+ *
+ * Description:
+ *   ISR for the high half. The counter keeps running and matches again
+ *   after wrapping, so only the armed match is reported.
+ *
+ ****************************************************************************/
+
+void gap8_timer_hi_isr(void)
+{
+  if (!_timer_hi.armed)
+    {
+      return;
+    }
+
+  /* The callback may arm the next one-shot */
+
+  _timer_hi.armed = false;
+  if (_timer_hi.on_timer)
+    {
+      _timer_hi.on_timer(_timer_hi.arg);
+    }
+}
+
+/****************************************************************************
+ * Name: gap8_timer_set_deadline
+ *
+ * Description:
+ *   Tickless mode only. Call the timer callback once, `ticks` ticks from
+ *   now, replacing any pending deadline. 0 cancels the deadline.
+ *
+ ****************************************************************************/
+
+int gap8_timer_set_deadline(uint32_t ticks)
+{
+  uint64_t now;
+  uint32_t flags;
+
+  if (fc_basic_timer.mode != TIM_MODE_TICKLESS)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  now = _account();
+  if (ticks == 0)
+    {
+      fc_basic_timer.deadline_us = NO_DEADLINE;
+    }
+  else
+    {
+      fc_basic_timer.deadline_us = now +
+        ((uint64_t)ticks * 1000000) / fc_basic_timer.tick_per_second;
+    }
+
+  _program_oneshot(now);
+
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_gettime_us
+ *
+ * Description:
+ *   Tickless or cascaded mode only. Microseconds elapsed since
+ *   initialization.
+ *
+ ****************************************************************************/
+
+uint64_t gap8_timer_gettime_us(void)
+{
+  uint64_t now;
+  uint32_t flags;
+
+  if (fc_basic_timer.mode == TIM_MODE_CASCADE)
+    {
+      return _cascade_us(gap8_clock_read());
+    }
+
+  flags = up_irq_save();
+  now = _account();
+  up_irq_restore(flags);
+
+  return now;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_getticks
+ *
+ * Description:
+ *   Tickless or cascaded mode only. Ticks elapsed since initialization.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_getticks(void)
+{
+  return (uint32_t)((gap8_timer_gettime_us() *
+                    fc_basic_timer.tick_per_second) / 1000000);
+}
+
+/****************************************************************************
+ * Name: gap8_timer_idle
+ *
+ * Description:
+ *   Sleep on the event unit until the timer fires, or any event in
+ *   `event_mask` arrives.
+ *
+ ****************************************************************************/
+
+void gap8_timer_idle(uint32_t event_mask)
+{
+  gap8_sleep_wait_sw_evnt((1L << GAP8_IRQ_FC_TIMER_LO) | event_mask);
+}
+
 /****************************************************************************
  * Name: gap8_register_callback
  *
@@ -82,6 +706,45 @@ void gap8_register_timercallback(void (*on_timer)(void*arg), void *arg)
   fc_basic_timer.arg = arg;
 }
 
+/****************************************************************************
+ * Name: gap8_timer_getcount
+ *
+ * Description:
+ *   Current value of the counter, in timer ticks.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_getcount(void)
+{
+  return fc_basic_timer.reg->VALUE_LO;
+}
+
+/****************************************************************************
+ * Name: gap8_timer_elapsed
+ *
+ * Description:
+ *   Ticks elapsed since `stamp`. The counter wraps at CMP_LO in cyclic mode,
+ *   and runs freely in tickless and cascaded modes.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_elapsed(uint32_t stamp)
+{
+  uint32_t now = fc_basic_timer.reg->VALUE_LO;
+
+  if (fc_basic_timer.mode != TIM_MODE_PERIODIC)
+    {
+      return now - stamp;
+    }
+
+  if (now < stamp)
+    {
+      now += fc_basic_timer.reg->CMP_LO;
+    }
+
+  return now - stamp;
+}
+
 /****************************************************************************
  * Name: gap8_timer_isr
  *
@@ -92,6 +755,37 @@ void gap8_register_timercallback(void (*on_timer)(void*arg), void *arg)
 
 void gap8_timer_isr(void)
 {
+  uint64_t now;
+
+  /* Complete a pending FLL retune */
+
+  gap8_fll_poll();
+
+  if (fc_basic_timer.mode == TIM_MODE_CASCADE)
+    {
+      _program_cascade();
+    }
+  else if (fc_basic_timer.mode == TIM_MODE_TICKLESS)
+    {
+      /* It may only be a wakeup to account the time */
+
+      now = _account();
+      if (now < fc_basic_timer.deadline_us)
+        {
+          _program_oneshot(now);
+          return;
+        }
+
+      /* The callback may set the next deadline */
+
+      fc_basic_timer.deadline_us = NO_DEADLINE;
+      if (fc_basic_timer.on_timer)
+        fc_basic_timer.on_timer(fc_basic_timer.arg);
+
+      _program_oneshot(_account());
+      return;
+    }
+
   if (fc_basic_timer.on_timer)
     fc_basic_timer.on_timer(fc_basic_timer.arg);
 }
@@ -6,6 +6,22 @@
  * 
  *  We won't exhaust all the features of GAP8.
  * 
+ *  Three modes, chosen by the initialization function:
+ *  - periodic: low half at 1MHz, reset on every tick.
+ *  - tickless: low half at 1MHz, free running, one-shot deadlines.
+ *  - cascaded: both halves as one 64-bit counter at the FLL rate, free running,
+ *    ticks from a re-armed 64-bit compare. gap8_clock_read() then returns
+ *    cycle-level, non-wrapping timestamps. The high half is not available for
+ *    anything else, and the boot profiler's 32kHz count is lost.
+ *
+ *  Out of cascaded mode, the high half could run as an independent channel at the
+ *  FLL rate, for precise one-shot events on its own IRQ (gap8_timer_hi_*). It
+ *  also takes over the boot profiler's count, so start it after the boot stamps.
+ *
+ *  Both halves follow gap8_setfreq(): the 1MHz prescaler, the tick period and a
+ *  pending high half one-shot are recomputed for the new rate, and the time
+ *  counted so far is kept.
+ * 
  * Author: hhuysqt <1020988872@qq.com>
  * 
  ************************************************************************************/
@@ -18,6 +34,35 @@
  ************************************************************************************/
 
 #include "GAP8.h"
+#include <stdbool.h>
+
+/************************************************************************************
+ * Inline Functions
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_clock_read
+ *
+ * Description:
+ *   Cascaded mode only. Read the 64-bit counter, in cycles at
+ *   gap8_clock_hz(). The high half is read again to catch a carry from
+ *   the low half in between.
+ *
+ ****************************************************************************/
+
+static inline uint64_t gap8_clock_read(void)
+{
+  uint32_t hi, lo;
+
+  do
+    {
+      hi = BASIC_TIM->VALUE_HI;
+      lo = BASIC_TIM->VALUE_LO;
+    }
+  while (hi != BASIC_TIM->VALUE_HI);
+
+  return ((uint64_t)hi << 32) | lo;
+}
 
 /************************************************************************************
  * Public Function Prototypes
@@ -34,6 +79,197 @@
 
 void gap8_timer_initialize(uint32_t source_clock, uint32_t tick_per_second);
 
+/****************************************************************************
+ * Name: gap8_timer_tickless_initialize
+ *
+ * Description:
+ *   Initialize the timer in tickless mode: no periodic IRQ, the callback is
+ *   only called on the deadline set by gap8_timer_set_deadline().
+ *
+ ****************************************************************************/
+
+void gap8_timer_tickless_initialize(uint32_t source_clock,
+                                    uint32_t tick_per_second);
+
+/****************************************************************************
+ * Name: gap8_timer_cascade_initialize
+ *
+ * Description:
+ *   Initialize the timer in cascaded mode: a 64-bit counter at
+ *   `source_clock`, the FLL rate, and `tick_per_second` periodic callbacks.
+ *   0 tick per second runs the clock alone, without IRQ.
+ *
+ ****************************************************************************/
+
+void gap8_timer_cascade_initialize(uint32_t source_clock,
+                                   uint32_t tick_per_second);
+
+/****************************************************************************
+ * Name: gap8_clock_hz
+ *
+ * Description:
+ *   Rate of gap8_clock_read() in Hz, or 0 if the timer is not cascaded.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_clock_hz(void);
+
+/****************************************************************************
+ * Name: gap8_clock_to_ns
+ *
+ * Description:
+ *   Convert cycles of gap8_clock_read() to nanoseconds. It divides 64-bit
+ *   values, so take the stamps in hot paths and convert them later. The
+ *   current rate is used, so spans across a gap8_setfreq() are off: use
+ *   gap8_timer_gettime_us() for those.
+ *
+ ****************************************************************************/
+
+uint64_t gap8_clock_to_ns(uint64_t cycles);
+
+/****************************************************************************
+ * Name: gap8_clock_to_us
+ *
+ * Description:
+ *   Convert cycles of gap8_clock_read() to microseconds.
+ *
+ ****************************************************************************/
+
+uint64_t gap8_clock_to_us(uint64_t cycles);
+
+/****************************************************************************
+ * Name: gap8_timer_hi_initialize
+ *
+ * Description:
+ *   Start the high half as an independent channel: a free running 32-bit
+ *   counter at `source_clock`, the FLL rate, with its own IRQ for one-shot
+ *   events. It does not share the tick IRQ, so the events do not jitter
+ *   with tick processing. Wraps every 2^32 cycles, ~21s at 200MHz.
+ *   Return ERROR in cascaded mode, where the high half is taken.
+ *   It resets the 32kHz count started by reset_handler: later
+ *   gap8_boot_stamp() calls only record cycles.
+ *
+ ****************************************************************************/
+
+int gap8_timer_hi_initialize(uint32_t source_clock);
+
+/****************************************************************************
+ * Name: gap8_timer_hi_now
+ *
+ * Description:
+ *   Current count of the high half, in cycles.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_hi_now(void);
+
+/****************************************************************************
+ * Name: gap8_timer_hi_us_to_cycles
+ *
+ * Description:
+ *   Convert microseconds to cycles of the high half.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_hi_us_to_cycles(uint32_t us);
+
+/****************************************************************************
+ * Name: gap8_timer_hi_oneshot_at
+ *
+ * Description:
+ *   Call `on_timer(arg)` once in ISR when the high half reaches `when`,
+ *   replacing a pending one-shot of the same `on_timer`. Chain absolute
+ *   deadlines from the previous one for bit timing, so that the ISR latency
+ *   does not accumulate:
+ *
+ *     next += bit_cycles;
+ *     gap8_timer_hi_oneshot_at(next, on_bit, dev);
+ *
+ *   There is a single one-shot: `on_timer` owns it until it fires or is
+ *   cancelled. Return ERROR if another `on_timer` owns it, if `when` is
+ *   already too close or behind, or if the channel is not initialized.
+ *
+ ****************************************************************************/
+
+int gap8_timer_hi_oneshot_at(uint32_t when, void (*on_timer)(void *arg),
+                             void *arg);
+
+/****************************************************************************
+ * Name: gap8_timer_hi_oneshot
+ *
+ * Description:
+ *   Call `on_timer(arg)` once in ISR, `us` microseconds from now. Delays
+ *   too short to program are rounded up. Return ERROR if another
+ *   `on_timer` owns the one-shot, or the channel is not initialized.
+ *
+ ****************************************************************************/
+
+int gap8_timer_hi_oneshot(uint32_t us, void (*on_timer)(void *arg), void *arg);
+
+/****************************************************************************
+ * Name: gap8_timer_hi_cancel
+ *
+ * Description:
+ *   Cancel the pending one-shot, if `on_timer` owns it.
+ *
+ ****************************************************************************/
+
+void gap8_timer_hi_cancel(void (*on_timer)(void *arg));
+
+/****************************************************************************
+ * Name: gap8_timer_hi_pending
+ *
+ * Description:
+ *   Return true if a one-shot of `on_timer` is pending.
+ *
+ ****************************************************************************/
+
+bool gap8_timer_hi_pending(void (*on_timer)(void *arg));
+
+/****************************************************************************
+ * Name: gap8_timer_set_deadline
+ *
+ * Description:
+ *   Tickless mode only. Call the timer callback once, `ticks` ticks from
+ *   now, replacing any pending deadline. 0 cancels the deadline.
+ *   Return ERROR if not in tickless mode.
+ *
+ ****************************************************************************/
+
+int gap8_timer_set_deadline(uint32_t ticks);
+
+/****************************************************************************
+ * Name: gap8_timer_gettime_us
+ *
+ * Description:
+ *   Tickless or cascaded mode only. Microseconds elapsed since
+ *   initialization.
+ *
+ ****************************************************************************/
+
+uint64_t gap8_timer_gettime_us(void);
+
+/****************************************************************************
+ * Name: gap8_timer_getticks
+ *
+ * Description:
+ *   Tickless or cascaded mode only. Ticks elapsed since initialization.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_getticks(void);
+
+/****************************************************************************
+ * Name: gap8_timer_idle
+ *
+ * Description:
+ *   Sleep on the event unit until the timer fires, or any event in
+ *   `event_mask` arrives.
+ *
+ ****************************************************************************/
+
+void gap8_timer_idle(uint32_t event_mask);
+
 /****************************************************************************
  * Name: gap8_register_timercallback
  *
@@ -44,6 +280,30 @@ void gap8_timer_initialize(uint32_t source_clock, uint32_t tick_per_second);
 
 void gap8_register_timercallback(void (*on_timer)(void*arg), void *arg);
 
+/****************************************************************************
+ * Name: gap8_timer_getcount
+ *
+ * Description:
+ *   Current value of the counter, in 1MHz ticks once the timer is
+ *   initialized, or low half in cycles in cascaded mode. Cheap enough for
+ *   timestamping in ISR. Note that in periodic mode the counter restarts
+ *   from 0 on every timer IRQ.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_getcount(void);
+
+/****************************************************************************
+ * Name: gap8_timer_elapsed
+ *
+ * Description:
+ *   Ticks elapsed since `stamp`, a value from gap8_timer_getcount(). Valid
+ *   for intervals shorter than one timer period.
+ *
+ ****************************************************************************/
+
+uint32_t gap8_timer_elapsed(uint32_t stamp);
+
 /****************************************************************************
  * Name: gap8_timer_isr
  *
@@ -54,4 +314,14 @@ void gap8_register_timercallback(void (*on_timer)(void*arg), void *arg);
 
 void gap8_timer_isr(void);
 
+/****************************************************************************
+ * Name: gap8_timer_hi_isr
+ *
+ * Description:
+ *   ISR for the high half
+ *
+ ****************************************************************************/
+
+void gap8_timer_hi_isr(void);
+
 #endif
@@ -26,14 +26,15 @@
 /* uart ISR routine */
 static void uart_tx_isr(struct gap8_udma_peripheral *arg);
 static void uart_rx_isr(struct gap8_udma_peripheral *arg);
+static void uart_clock_changed(uint32_t old_hz, uint32_t new_hz, void *arg);
 
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
-/* instantiate the UART */
+/* instantiate the UART. Touched by its ISR, so keep it in FC TCDM. */
 
-static struct gap8_uart_t uarts[GAP8_NR_UART] = {
+static struct gap8_uart_t uarts[GAP8_NR_UART] GAP8_FC_TCDM_DATA = {
   {
     .udma = {
       .regs  = (UDMA_reg_t*)UART,
@@ -49,6 +50,11 @@ static struct gap8_uart_t uarts[GAP8_NR_UART] = {
     .nr_bits = 8,
     .parity_enable = 0,
     .stop_bits = 1,
+
+    .clk_nb = {
+      .post_change = uart_clock_changed,
+      .arg = &uarts[0],
+    },
   }
 };
 
@@ -58,12 +64,43 @@ int uarttxcnt = 0;
  ****************************************************************************/
 static void uart_tx_isr(struct gap8_udma_peripheral *arg)
 {
+  struct gap8_uart_t *the_uart = (struct gap8_uart_t*)arg;
+
   uarttxcnt++;
+  gap8_complete(&the_uart->tx_done);
 }
 
 static void uart_rx_isr(struct gap8_udma_peripheral *arg)
 {
+  struct gap8_uart_t *the_uart = (struct gap8_uart_t*)arg;
+
+  gap8_complete(&the_uart->rx_done);
+}
+
+static void uart_setdiv(struct gap8_uart_t *uart, uint32_t baud, uint32_t coreclock)
+{
+  uint16_t div = coreclock / baud;
+  UART_reg_t *uartreg = (UART_reg_t*)uart->udma.regs;
+
+  gap8_udma_wake(&uart->udma);
+  uartreg->SETUP = (uartreg->SETUP & ~(UART_SETUP_CLKDIV_MASK)) | UART_SETUP_CLKDIV(div);
+
+  uart->coreclock = coreclock;
+  uart->baud = baud;
+}
+
+/* The peripheral clock follows the FLL. A character on the line while the
+ * FLL locks is garbled anyway, so callers retune between transfers: the
+ * DVFS governor waits for gap8_udma_busy() to clear. */
+
+static void uart_clock_changed(uint32_t old_hz, uint32_t new_hz, void *arg)
+{
+  struct gap8_uart_t *the_uart = (struct gap8_uart_t*)arg;
 
+  if (the_uart->coreclock)
+    {
+      uart_setdiv(the_uart, the_uart->baud, new_hz);
+    }
 }
 
 
@@ -77,6 +114,7 @@ struct gap8_uart_t * gap8_uart_initialize(int n)
   struct gap8_uart_t *the_uart;
   UART_reg_t *uartreg;
   uint32_t cfgreg = 0;
+  uint32_t pins[2];
 
   if (n >= GAP8_NR_UART)
     return NULL;
@@ -84,7 +122,27 @@ struct gap8_uart_t * gap8_uart_initialize(int n)
   the_uart = &uarts[n];
   uartreg = (UART_reg_t*)the_uart->udma.regs;
 
-  gap8_udma_init(&the_uart->udma);
+  /* Initializing again only reprograms the hardware: the events and the
+   * channel reference are kept */
+
+  if (!the_uart->initialized)
+    {
+      if (gap8_completion_init(&the_uart->tx_done) != OK)
+        return NULL;
+      if (gap8_completion_init(&the_uart->rx_done) != OK)
+        {
+          gap8_completion_destroy(&the_uart->tx_done);
+          return NULL;
+        }
+      if (gap8_udma_init(&the_uart->udma) != OK)
+        {
+          gap8_completion_destroy(&the_uart->rx_done);
+          gap8_completion_destroy(&the_uart->tx_done);
+          return NULL;
+        }
+
+      the_uart->initialized = true;
+    }
 
   /* Setup baudrate etc. */
   cfgreg = UART_SETUP_BIT_LENGTH(the_uart->nr_bits - 5) | 
@@ -94,8 +152,9 @@ struct gap8_uart_t * gap8_uart_initialize(int n)
            UART_SETUP_RX_ENA(1);
   uartreg->SETUP = cfgreg;
 
-  gap8_configpin(the_uart->tx_gpio);
-  gap8_configpin(the_uart->rx_gpio);
+  pins[0] = the_uart->tx_gpio;
+  pins[1] = the_uart->rx_gpio;
+  gap8_configpins(pins, 2);
 
   gap8_udma_tx_setirq(&the_uart->udma, 1);
   gap8_udma_rx_setirq(&the_uart->udma, 1);
@@ -103,37 +162,47 @@ struct gap8_uart_t * gap8_uart_initialize(int n)
   return the_uart;
 }
 
+/* The divider is then kept up to date with gap8_setfreq() */
 void gap8_uart_setbaud(struct gap8_uart_t *uart, uint32_t baud, uint32_t coreclock)
 {
-  uint16_t div = coreclock / baud;
-  UART_reg_t *uartreg = (UART_reg_t*)uart->udma.regs;
+  uint32_t flags;
 
-  uartreg->SETUP = (uartreg->SETUP & ~(UART_SETUP_CLKDIV_MASK)) | UART_SETUP_CLKDIV(div);
+  flags = up_irq_save();
+  uart_setdiv(uart, baud, coreclock);
+  up_irq_restore(flags);
 
-  uart->coreclock = coreclock;
-  uart->baud = baud;
+  gap8_fll_register_notifier(&uart->clk_nb);
 }
 
-void gap8_uart_sendbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes)
+/* Return ERROR, without waiting, if uDMA cannot reach `buff` */
+int gap8_uart_sendbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes)
 {
   struct gap8_udma_peripheral *theudma = &uart->udma;
+  int ret;
 
-  gap8_udma_tx_start(theudma, buff, nbytes, 1);
-  while (gap8_udma_tx_poll(theudma) != OK)
+  gap8_completion_reinit(&uart->tx_done);
+  ret = gap8_udma_tx_start(theudma, buff, nbytes, 1);
+  if (ret == OK)
     {
-      gap8_sleep_wait_sw_evnt(1 << 3);
+      gap8_wait_for_completion(&uart->tx_done);
     }
+
+  return ret;
 }
 
-void gap8_uart_recvbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes)
+int gap8_uart_recvbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes)
 {
   struct gap8_udma_peripheral *theudma = &uart->udma;
+  int ret;
 
-  gap8_udma_rx_start(theudma, buff, nbytes, 1);
-  while (gap8_udma_rx_poll(theudma) != OK)
+  gap8_completion_reinit(&uart->rx_done);
+  ret = gap8_udma_rx_start(theudma, buff, nbytes, 1);
+  if (ret == OK)
     {
-      gap8_sleep_wait_sw_evnt(1 << 3);
+      gap8_wait_for_completion(&uart->rx_done);
     }
+
+  return ret;
 }
 
 
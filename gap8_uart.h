@@ -15,6 +15,8 @@
 #include "GAP8.h"
 #include "gap8_udma.h"
 #include "gap8_gpio.h"
+#include "gap8_sync.h"
+#include "gap8_fll.h"
 
 /************************************************************************************
  * Pre-processor Definitions
@@ -42,6 +44,16 @@ struct gap8_uart_t {
   uint8_t  nr_bits;
   uint8_t  parity_enable;
   uint8_t  stop_bits;
+  bool     initialized;     /* events and uDMA reference taken */
+
+  /* recompute the divider on FLL changes */
+
+  struct gap8_fll_notifier_s clk_nb;
+
+  /* signaled by uDMA ISR */
+
+  struct gap8_completion_s tx_done;
+  struct gap8_completion_s rx_done;
 };
 
 /************************************************************************************
@@ -51,7 +63,9 @@ struct gap8_uart_t {
 /* Tests */
 struct gap8_uart_t * gap8_uart_initialize(int n);
 void gap8_uart_setbaud(struct gap8_uart_t *uart, uint32_t baud, uint32_t clock);
-void gap8_uart_sendbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes);
-void gap8_uart_recvbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes);
+
+/* Blocking transfers. `buff` must be in L2, see GAP8_L2_DMA: ERROR otherwise */
+int gap8_uart_sendbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes);
+int gap8_uart_recvbytes(struct gap8_uart_t *uart, uint8_t *buff, uint32_t nbytes);
 
 #endif
@@ -14,6 +14,7 @@
  ************************************************************************************/
 
 #include "gap8_udma.h"
+#include "gap8_swtimer.h"
 #include <stddef.h>
 
 /****************************************************************************
@@ -33,8 +34,26 @@
 
 /* uDMA peripheral instances
  * The peripheral driver instanciate it and register through _init()
+ * Looked up on every uDMA IRQ, so keep it in FC TCDM.
  **/
-static struct gap8_udma_peripheral *_peripherals[GAP8_UDMA_NR_CHANNELS] = { 0 };
+static struct gap8_udma_peripheral *_peripherals[GAP8_UDMA_NR_CHANNELS]
+  GAP8_FC_TCDM_BSS;
+
+/* Clock gating of the channels, by reference count and idle time.
+ * Touched on every submit, so keep it in FC TCDM too. */
+static struct {
+  uint32_t idle_ticks;                  /* 0: no automatic gating      */
+  uint32_t gated;                       /* in use, but gated for idle  */
+  uint8_t  users[GAP8_UDMA_NR_CHANNELS];
+  uint32_t last_active[GAP8_UDMA_NR_CHANNELS];
+  uint32_t gated_at[GAP8_UDMA_NR_CHANNELS];
+  uint32_t gates[GAP8_UDMA_NR_CHANNELS];
+  uint32_t wakes[GAP8_UDMA_NR_CHANNELS];
+  uint32_t gated_ticks[GAP8_UDMA_NR_CHANNELS];
+} _cg GAP8_FC_TCDM_BSS;
+
+/* Scans for idle channels */
+static struct gap8_swtimer_s _cg_timer;
 
 
 /****************************************************************************
@@ -55,6 +74,50 @@ static void _dma_rxstart(struct gap8_udma_peripheral *the_peri)
   the_peri->regs->RX_CFG   = UDMA_CFG_EN(1);
 }
 
+/* Ungate the clock of a channel gated for idle, and mark it active.
+ * Must be called with IRQ disabled. */
+
+static void _cg_wake(uint32_t id)
+{
+  uint32_t now = gap8_swtimer_now();
+
+  if (_cg.gated & (1L << id))
+    {
+      UDMA_GC->CG |= (1L << id);
+      _cg.gated &= ~(1L << id);
+      _cg.wakes[id]++;
+      _cg.gated_ticks[id] += now - _cg.gated_at[id];
+    }
+
+  _cg.last_active[id] = now;
+}
+
+/* Gate the channels in use, but without transfer for idle_ticks */
+
+static void _cg_scan(void *arg)
+{
+  struct gap8_udma_peripheral *the_peri;
+  uint32_t now = gap8_swtimer_now();
+  uint32_t id;
+
+  for (id = 0; id < GAP8_UDMA_NR_CHANNELS; id++)
+    {
+      the_peri = _peripherals[id];
+      if (_cg.users[id] == 0 || the_peri == NULL ||
+          (_cg.gated & (1L << id)) ||
+          the_peri->tx.block_count > 0 || the_peri->rx.block_count > 0 ||
+          now - _cg.last_active[id] < _cg.idle_ticks)
+        {
+          continue;
+        }
+
+      UDMA_GC->CG &= ~(1L << id);
+      _cg.gated |= (1L << id);
+      _cg.gated_at[id] = now;
+      _cg.gates[id]++;
+    }
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -63,7 +126,9 @@ static void _dma_rxstart(struct gap8_udma_peripheral *the_peri)
  * Name: gap8_udma_init
  *
  * Description:
- *   Initialize (and enable) a udma peripheral.
+ *   Initialize (and enable) a udma peripheral. Each call takes a reference
+ *   on the channel clock. Return ERROR if the channel has UINT8_MAX users
+ *   already.
  * 
  * Input:
  *   instance: pointer to a peripheral instance connected to uDMA
@@ -73,37 +138,166 @@ static void _dma_rxstart(struct gap8_udma_peripheral *the_peri)
 int gap8_udma_init(struct gap8_udma_peripheral *instance)
 {
   uint32_t id;
+  uint32_t flags;
 
   CHECK_CHANNEL_ID(instance)
 
   id = instance->id;
+
+  flags = up_irq_save();
+
+  if (_cg.users[id] == UINT8_MAX)
+    {
+      up_irq_restore(flags);
+      return ERROR;
+    }
+
   _peripherals[id] = instance;
 
   /* Enable clock gating */
 
-  UDMA_GC->CG |= (1L << id);
+  if (_cg.users[id]++ == 0)
+    {
+      UDMA_GC->CG |= (1L << id);
+    }
+  _cg_wake(id);
+
+  up_irq_restore(flags);
+
+  return OK;
 }
 
 /************************************************************************************
  * Name: gap8_udma_deinit
  * 
  * Description:
- *   Deinit a udma peripheral
+ *   Deinit a udma peripheral. The channel clock is gated when its last
+ *   reference is dropped. Return ERROR if not initialized.
  * 
  ************************************************************************************/
 
 int gap8_udma_deinit(struct gap8_udma_peripheral *instance)
 {
   uint32_t id;
+  uint32_t flags;
 
   CHECK_CHANNEL_ID(instance)
 
   id = instance->id;
-  _peripherals[id] = NULL;
 
-  /* Disable clock gating */
+  flags = up_irq_save();
+
+  if (_cg.users[id] == 0)
+    {
+      up_irq_restore(flags);
+      return ERROR;
+    }
+
+  if (--_cg.users[id] == 0)
+    {
+      _cg_wake(id);
+      _peripherals[id] = NULL;
+
+      /* Disable clock gating */
+
+      UDMA_GC->CG &= ~(1L << id);
+    }
+
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/************************************************************************************
+ * Name: gap8_udma_wake
+ *
+ * Description:
+ *   Ungate the channel clock if it was gated for idle, e.g. before touching
+ *   the peripheral registers. Submitting a transfer does it already.
+ *
+ ************************************************************************************/
+
+int gap8_udma_wake(struct gap8_udma_peripheral *instance)
+{
+  uint32_t flags;
+
+  CHECK_CHANNEL_ID(instance)
+
+  flags = up_irq_save();
+  _cg_wake(instance->id);
+  up_irq_restore(flags);
+
+  return OK;
+}
+
+/************************************************************************************
+ * Name: gap8_udma_autogate
+ *
+ * Description:
+ *   Gate the clock of the channels in use but without transfer for
+ *   `idle_ticks` software timer ticks. 0 stops it and ungates them all.
+ *
+ ************************************************************************************/
+
+void gap8_udma_autogate(uint32_t idle_ticks)
+{
+  uint32_t flags;
+  uint32_t id;
+
+  gap8_swtimer_stop(&_cg_timer);
+
+  flags = up_irq_save();
+
+  _cg.idle_ticks = idle_ticks;
+  if (idle_ticks == 0)
+    {
+      for (id = 0; id < GAP8_UDMA_NR_CHANNELS; id++)
+        {
+          _cg_wake(id);
+        }
+    }
+
+  up_irq_restore(flags);
+
+  if (idle_ticks)
+    {
+      gap8_swtimer_init(&_cg_timer, _cg_scan, NULL);
+      gap8_swtimer_start(&_cg_timer, idle_ticks, idle_ticks);
+    }
+}
+
+/************************************************************************************
+ * Name: gap8_udma_getcgstat
+ *
+ * Description:
+ *   Get the clock gating state and counters of channel `id`.
+ *
+ ************************************************************************************/
+
+int gap8_udma_getcgstat(uint32_t id, struct gap8_udma_cgstat_s *stat)
+{
+  uint32_t flags;
+
+  if (id >= GAP8_UDMA_NR_CHANNELS)
+    {
+      return ERROR;
+    }
+
+  flags = up_irq_save();
+
+  stat->users = _cg.users[id];
+  stat->gated = (_cg.gated & (1L << id)) != 0;
+  stat->gates = _cg.gates[id];
+  stat->wakes = _cg.wakes[id];
+  stat->gated_ticks = _cg.gated_ticks[id];
+  if (stat->gated)
+    {
+      stat->gated_ticks += gap8_swtimer_now() - _cg.gated_at[id];
+    }
+
+  up_irq_restore(flags);
 
-  UDMA_GC->CG &= ~(1L << id);
+  return OK;
 }
 
 /************************************************************************************
@@ -167,13 +361,26 @@ int gap8_udma_rx_setirq(struct gap8_udma_peripheral *instance, bool enable)
  * This function may be called on ISR, so it cannot be blocked. The caller should
  * manage the muxing.
  * 
+ * Return ERROR if `buff` is not in L2.
+ * 
  ************************************************************************************/
 
 int gap8_udma_tx_start(struct gap8_udma_peripheral *instance, 
                    uint8_t *buff, uint32_t size, int count)
 {
+  uint32_t flags;
+
   CHECK_CHANNEL_ID(instance)
+
+  if (!GAP8_IS_L2(buff))
+    {
+      return ERROR;
+    }
   
+  flags = up_irq_save();
+  _cg_wake(instance->id);
+  up_irq_restore(flags);
+
   instance->tx.buff = buff;
   instance->tx.block_size = size;
   instance->tx.block_count = count;
@@ -192,15 +399,27 @@ int gap8_udma_tx_start(struct gap8_udma_peripheral *instance,
  * This function may be called on ISR, so it cannot be blocked. The caller should
  * manage the muxing.
  * 
+ * Return ERROR if `buff` is not in L2.
+ * 
  ************************************************************************************/
 
 int gap8_udma_rx_start(struct gap8_udma_peripheral *instance,
                    uint8_t *buff, uint32_t size, int count)
 {
   struct __udma_queue *thisreq;
+  uint32_t flags;
 
   CHECK_CHANNEL_ID(instance)
+
+  if (!GAP8_IS_L2(buff))
+    {
+      return ERROR;
+    }
   
+  flags = up_irq_save();
+  _cg_wake(instance->id);
+  up_irq_restore(flags);
+
   instance->rx.buff = buff;
   instance->rx.block_size = size;
   instance->rx.block_count = count;
@@ -240,6 +459,32 @@ int gap8_udma_rx_poll(struct gap8_udma_peripheral *instance)
   return instance->rx.block_count <= 0 ? OK : ERROR;
 }
 
+/************************************************************************************
+ * Name: gap8_udma_busy
+ * 
+ * Description:
+ *   Return true if any channel has a transfer in flight.
+ * 
+ ************************************************************************************/
+
+bool gap8_udma_busy(void)
+{
+  struct gap8_udma_peripheral *the_peri;
+  uint32_t id;
+
+  for (id = 0; id < GAP8_UDMA_NR_CHANNELS; id++)
+    {
+      the_peri = _peripherals[id];
+      if (the_peri != NULL &&
+          (the_peri->tx.block_count > 0 || the_peri->rx.block_count > 0))
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
 /************************************************************************************
  * Name: gap8_udma_doirq
  * 
@@ -274,6 +519,7 @@ void gap8_udma_doirq(uint32_t irqn)
 
           the_peripheral->regs->TX_CFG = UDMA_CFG_CLR(1);
           the_peripheral->tx.block_count = 0;
+          _cg.last_active[irqn >> 1] = gap8_swtimer_now();
           if (the_peripheral->on_tx)
             {
               the_peripheral->on_tx(the_peripheral);
@@ -294,6 +540,7 @@ void gap8_udma_doirq(uint32_t irqn)
 
           the_peripheral->regs->RX_CFG = UDMA_CFG_CLR(1);
           the_peripheral->rx.block_count = 0;
+          _cg.last_active[irqn >> 1] = gap8_swtimer_now();
           if (the_peripheral->on_rx)
             {
               the_peripheral->on_rx(the_peripheral);
@@ -8,6 +8,12 @@
  *  uDMA sybsystem drivers are object oriented to some extend. Peripherals inherit
  *  the udma class, which handels all the data exchange stuff.
  * 
+ *  The clock of a channel is on while it has users: gap8_udma_init() and
+ *  gap8_udma_deinit() take and drop a reference. With gap8_udma_autogate(), a
+ *  channel without transfer for some software timer ticks is gated too, and
+ *  ungated on its next submit. Touch the peripheral registers out of a transfer
+ *  after gap8_udma_wake().
+ * 
  * Author: hhuysqt <1020988872@qq.com>
  * 
  ************************************************************************************/
@@ -20,6 +26,7 @@
 
 #include "GAP8.h"
 #include "gap8_interrupt.h"
+#include "gap8_section.h"
 #include <stdbool.h>
 
 /************************************************************************************
@@ -79,7 +86,18 @@ struct gap8_udma_peripheral {
   struct __udma_queue tx;        /* TX queue */
   struct __udma_queue rx;        /* RX queue */
 
-  // TODO: semaphores
+  /* Blocking is left to the peripheral drivers, who wait on the objects of
+   * gap8_sync signaled from on_tx/on_rx. */
+};
+
+/* Clock gating counters of a channel */
+
+struct gap8_udma_cgstat_s {
+  uint32_t users;
+  bool     gated;               /* gated for idle now             */
+  uint32_t gates;               /* times gated for idle           */
+  uint32_t wakes;               /* times ungated on submit        */
+  uint32_t gated_ticks;         /* software timer ticks gated     */
 };
 
 
@@ -91,7 +109,9 @@ struct gap8_udma_peripheral {
  * Name: gap8_udma_init
  *
  * Description:
- *   Initialize (and enable) a udma peripheral.
+ *   Initialize (and enable) a udma peripheral. Each call takes a reference
+ *   on the channel clock. Return ERROR on a bad channel, or if it has
+ *   UINT8_MAX users already.
  * 
  * Input:
  *   instance: pointer to a peripheral instance connected to uDMA
@@ -104,12 +124,47 @@ int gap8_udma_init(struct gap8_udma_peripheral *instance);
  * Name: gap8_udma_deinit
  * 
  * Description:
- *   Deinit a udma peripheral
+ *   Deinit a udma peripheral. The channel clock is gated when its last
+ *   reference is dropped. Return ERROR if not initialized.
  * 
  ************************************************************************************/
 
 int gap8_udma_deinit(struct gap8_udma_peripheral *instance);
 
+/************************************************************************************
+ * Name: gap8_udma_wake
+ *
+ * Description:
+ *   Ungate the channel clock if it was gated for idle, e.g. before touching
+ *   the peripheral registers. Submitting a transfer does it already.
+ *
+ ************************************************************************************/
+
+int gap8_udma_wake(struct gap8_udma_peripheral *instance);
+
+/************************************************************************************
+ * Name: gap8_udma_autogate
+ *
+ * Description:
+ *   Gate the clock of the channels in use but without transfer for
+ *   `idle_ticks` software timer ticks, see gap8_swtimer.h. 0 stops it and
+ *   ungates them all.
+ *
+ ************************************************************************************/
+
+void gap8_udma_autogate(uint32_t idle_ticks);
+
+/************************************************************************************
+ * Name: gap8_udma_getcgstat
+ *
+ * Description:
+ *   Get the clock gating state and counters of channel `id`. Return ERROR
+ *   on a bad channel.
+ *
+ ************************************************************************************/
+
+int gap8_udma_getcgstat(uint32_t id, struct gap8_udma_cgstat_s *stat);
+
 /************************************************************************************
  * Name: gap8_udma_tx_setirq
  *
@@ -178,6 +233,17 @@ int gap8_udma_tx_poll(struct gap8_udma_peripheral *instance);
 
 int gap8_udma_rx_poll(struct gap8_udma_peripheral *instance);
 
+/************************************************************************************
+ * Name: gap8_udma_busy
+ * 
+ * Description:
+ *   Return true if any channel has a transfer in flight. Call with IRQ
+ *   disabled for the answer to hold.
+ * 
+ ************************************************************************************/
+
+bool gap8_udma_busy(void);
+
 /************************************************************************************
  * Name: gap8_udma_doirq
  * 
@@ -0,0 +1,226 @@
+/************************************************************************************
+ * Deferred work (bottom halves) for GAP8 FC
+ *  ISRs run with interrupts disabled, so they should only acknowledge the hardware
+ *  and queue the rest of the job here. Each work queue owns one FC software event
+ *  with its IRQ enabled. Queuing a work triggers that event, and its handler then
+ *  runs the queued works with interrupts enabled, so any other IRQ preempts them.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "gap8_workq.h"
+#include "gap8_sync.h"
+#include "gap8_interrupt.h"
+#include "gap8_perf.h"
+#include "gap8_section.h"
+#include <stddef.h>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Work queue bound to each software event, looked up on every dispatch */
+static struct gap8_workq_s *_workqs[GAP8_SYNC_NR_EVENTS] GAP8_FC_TCDM_BSS;
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_workq_init
+ *
+ * Description:
+ *   Initialize a work queue over `works` of `depth` entries, where `depth`
+ *   is a power of 2. A software event is allocated and its IRQ enabled.
+ *   Return ERROR on bad depth or if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_workq_init(struct gap8_workq_s *wq, struct gap8_work_s *works,
+                    uint32_t depth)
+{
+  int event;
+
+  if (works == NULL || depth == 0 || (depth & (depth - 1)) != 0)
+    {
+      return ERROR;
+    }
+
+  event = gap8_sync_alloc_event();
+  if (event < 0)
+    {
+      return ERROR;
+    }
+
+  wq->works = works;
+  wq->mask = depth - 1;
+  wq->head = 0;
+  wq->tail = 0;
+  wq->event = event;
+  wq->running = false;
+  gap8_workq_getstat(wq, &wq->stat, true);
+
+  _workqs[event] = wq;
+  up_enable_irq(event);
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_workq_deinit
+ *
+ * Description:
+ *   Disable the queue's IRQ and release its event. Pending works are lost.
+ *
+ ****************************************************************************/
+
+void gap8_workq_deinit(struct gap8_workq_s *wq)
+{
+  up_disable_irq(wq->event);
+  _workqs[wq->event] = NULL;
+  gap8_sync_free_event(wq->event);
+}
+
+/****************************************************************************
+ * Name: gap8_workq_queue
+ *
+ * Description:
+ *   Queue `worker(arg)` to be run later. Return ERROR if the queue is full.
+ *   Safe to call from ISR and from the workers themselves.
+ *
+ ****************************************************************************/
+
+int gap8_workq_queue(struct gap8_workq_s *wq, void (*worker)(void *arg),
+                     void *arg)
+{
+  struct gap8_work_s *work;
+  uint32_t flags, depth;
+
+  /* Producers are ISRs as well as the main flow, so they are serialized by
+   * masking interrupts. The consumer only ever moves `tail`. */
+
+  flags = up_irq_save();
+
+  depth = wq->head - wq->tail;
+  if (depth > wq->mask)
+    {
+      wq->stat.dropped++;
+      up_irq_restore(flags);
+      return ERROR;
+    }
+
+  work = &wq->works[wq->head & wq->mask];
+  work->worker = worker;
+  work->arg = arg;
+  work->stamp = gap8_perf_read();
+  wq->head++;
+
+  wq->stat.queued++;
+  if (depth + 1 > wq->stat.depth_max)
+    {
+      wq->stat.depth_max = depth + 1;
+    }
+
+  up_irq_restore(flags);
+
+  EU_SW_EVNT_TRIG->TRIGGER_SET[wq->event] = 0;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: gap8_workq_getstat
+ *
+ * Description:
+ *   Copy the statistics of the queue, and clear them if `reset`.
+ *
+ ****************************************************************************/
+
+void gap8_workq_getstat(struct gap8_workq_s *wq,
+                        struct gap8_workq_stat_s *stat, bool reset)
+{
+  uint32_t flags;
+
+  flags = up_irq_save();
+  if (stat != &wq->stat)
+    {
+      *stat = wq->stat;
+    }
+  if (reset)
+    {
+      wq->stat.queued = 0;
+      wq->stat.done = 0;
+      wq->stat.dropped = 0;
+      wq->stat.depth_max = 0;
+      wq->stat.latency_max = 0;
+      wq->stat.latency_total = 0;
+    }
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: gap8_workq_dispatch
+ *
+ * Description:
+ *   Called from gap8_dispatch_irq on a software event IRQ. Run the works of
+ *   the queue bound to that event.
+ *
+ ****************************************************************************/
+
+void gap8_workq_dispatch(uint32_t event)
+{
+  struct gap8_workq_s *wq;
+  struct gap8_work_s work;
+  uint32_t flags, latency;
+
+  if (event >= GAP8_SYNC_NR_EVENTS)
+    {
+      return;
+    }
+
+  /* Works queued from now on raise the event again */
+
+  FCEU->BUFFER_CLEAR = (1L << event);
+
+  wq = _workqs[event];
+  if (wq == NULL || wq->running)
+    {
+      /* Preempted a running instance, which will drain the new works */
+
+      return;
+    }
+
+  wq->running = true;
+
+  /* The queue is checked, and the statistics updated, with IRQ disabled:
+   * a work queued after the last check was bounced by `running`, and the
+   * producers and gap8_workq_getstat() see consistent numbers. */
+
+  while (wq->tail != wq->head)
+    {
+      work = wq->works[wq->tail & wq->mask];
+      wq->tail++;
+
+      latency = gap8_perf_read() - work.stamp;
+      wq->stat.done++;
+      wq->stat.latency_total += latency;
+      if (latency > wq->stat.latency_max)
+        {
+          wq->stat.latency_max = latency;
+        }
+
+      /* Let other IRQs preempt the work. mstatus (and so MPIE/MPP) is put
+       * back before returning to the trap wrapper. */
+
+      flags = up_irq_enable();
+      work.worker(work.arg);
+      up_irq_restore(flags);
+    }
+
+  wq->running = false;
+}
@@ -0,0 +1,122 @@
+/************************************************************************************
+ * Deferred work (bottom halves) for GAP8 FC
+ *  ISRs run with interrupts disabled, so they should only acknowledge the hardware
+ *  and queue the rest of the job here. Each work queue owns one FC software event
+ *  with its IRQ enabled. Queuing a work triggers that event, and its handler then
+ *  runs the queued works with interrupts enabled, so any other IRQ preempts them.
+ *
+ *  Works are run in FIFO order, one at a time. Depth and queuing latency are
+ *  accounted per queue. Latencies are in core cycles, from the cycle counter
+ *  (see gap8_perf.h), so they do not depend on the timer setup. They are only
+ *  meaningful while the counter counts cycles, and below 2^32 cycles, ~21s at
+ *  200MHz.
+ *
+ * Author: hhuysqt <1020988872@qq.com>
+ *
+ ************************************************************************************/
+
+#ifndef GAP8_WORKQ_H
+#define GAP8_WORKQ_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include "GAP8.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/************************************************************************************
+ * Public Types
+ ************************************************************************************/
+
+/* One deferred job */
+struct gap8_work_s {
+  void (*worker)(void *arg);
+  void *arg;
+  uint32_t stamp;                 /* cycle counter when queued */
+};
+
+/* Statistics of a work queue */
+struct gap8_workq_stat_s {
+  uint32_t queued;                /* works accepted          */
+  uint32_t done;                  /* works executed          */
+  uint32_t dropped;               /* works rejected on full  */
+  uint32_t depth_max;             /* high watermark of depth */
+  uint32_t latency_max;           /* worst queue-to-run time, in cycles */
+  uint64_t latency_total;         /* sum of queue-to-run cycles, for the mean */
+};
+
+/* Work queue, a ring of `depth` works */
+struct gap8_workq_s {
+  struct gap8_work_s *works;
+  uint32_t mask;                  /* depth - 1 */
+  volatile uint32_t head;         /* free running write index */
+  volatile uint32_t tail;         /* free running read index  */
+  uint32_t event;                 /* FC software event        */
+  volatile bool running;
+  struct gap8_workq_stat_s stat;
+};
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+
+/****************************************************************************
+ * Name: gap8_workq_init
+ *
+ * Description:
+ *   Initialize a work queue over `works` of `depth` entries, where `depth`
+ *   is a power of 2. A software event is allocated and its IRQ enabled.
+ *   Return ERROR on bad depth or if no event is left.
+ *
+ ****************************************************************************/
+
+int gap8_workq_init(struct gap8_workq_s *wq, struct gap8_work_s *works,
+                    uint32_t depth);
+
+/****************************************************************************
+ * Name: gap8_workq_deinit
+ *
+ * Description:
+ *   Disable the queue's IRQ and release its event. Pending works are lost.
+ *
+ ****************************************************************************/
+
+void gap8_workq_deinit(struct gap8_workq_s *wq);
+
+/****************************************************************************
+ * Name: gap8_workq_queue
+ *
+ * Description:
+ *   Queue `worker(arg)` to be run later. Return ERROR if the queue is full.
+ *   Safe to call from ISR and from the workers themselves.
+ *
+ ****************************************************************************/
+
+int gap8_workq_queue(struct gap8_workq_s *wq, void (*worker)(void *arg),
+                     void *arg);
+
+/****************************************************************************
+ * Name: gap8_workq_getstat
+ *
+ * Description:
+ *   Copy the statistics of the queue, and clear them if `reset`.
+ *
+ ****************************************************************************/
+
+void gap8_workq_getstat(struct gap8_workq_s *wq,
+                        struct gap8_workq_stat_s *stat, bool reset);
+
+/****************************************************************************
+ * Name: gap8_workq_dispatch
+ *
+ * Description:
+ *   Called from gap8_dispatch_irq on a software event IRQ. Run the works of
+ *   the queue bound to that event.
+ *
+ ****************************************************************************/
+
+void gap8_workq_dispatch(uint32_t event);
+
+#endif
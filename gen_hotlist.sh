@@ -0,0 +1,24 @@
+#!/bin/sh
+# Generate the hot function link order included by GAP8.ld.
+#
+# Each symbol listed in the hot file gets its own input section statement, so
+# with -ffunction-sections the functions land contiguously at the start of
+# .text, in file order, and share as few icache sets as possible with the rest.
+# Symbols of assembly code name their section: `.text.<symbol>`.
+#
+# Usage: gen_hotlist.sh [hot file] [output]
+
+HOT=${1:-hot_symbols.txt}
+OUT=${2:-gap8_hot.ld}
+
+{
+  echo "/* Generated by gen_hotlist.sh from $HOT, do not edit */"
+  echo "*(.text.hot .text.hot.*)"
+  sed -e 's/#.*//' "$HOT" | awk '
+    NF == 0 { next }
+    $1 !~ /^[A-Za-z_][A-Za-z0-9_.$]*$/ {
+      print "gen_hotlist.sh: bad symbol `" $1 "`" > "/dev/stderr"
+      next
+    }
+    !seen[$1]++ { printf "*(.text.%s .text.%s.*)\n", $1, $1 }'
+} > "$OUT"
@@ -14,6 +14,9 @@
 #include "gap8_interrupt.h"
 #include "gap8_tim.h"
 #include "gap8_fll.h"
+#include "gap8_boot.h"
+#include "gap8_icache.h"
+#include "gap8_swtimer.h"
 
 /* Place a dummy debug_struct for plpbridge tool */
 struct _debug_struct {
@@ -49,9 +52,11 @@ int cnt = 0;
 extern uarttxcnt;
 
 /* IO buffer at L2 RAM */
-uint8_t buf[] = "hello world\r\n";
-uint8_t getbuf[10];
-uint8_t cntbuf[20];
+uint8_t buf[] GAP8_L2_DMA_DATA = "hello world\r\n";
+uint8_t getbuf[10] GAP8_L2_DMA;
+uint8_t cntbuf[20] GAP8_L2_DMA;
+
+static struct gap8_swtimer_s sec_timer;
 
 static void on_timer(void *arg)
 {
@@ -63,20 +68,33 @@ static void on_timer(void *arg)
 
 int main(void)
 {
-  SCBC->ICACHE_ENABLE = 0xFFFFFFFF;
+  uint32_t freq;
+
+  gap8_icache_enable(true);
   up_irqinitialize();
-  gap8_setfreq(TARGET_CLK_HZ);
+  gap8_boot_stamp(GAP8_BOOT_IRQ_INIT);
+  freq = gap8_setfreq(TARGET_CLK_HZ);
+  gap8_boot_stamp(GAP8_BOOT_FLL_LOCK);
 
   /* Serial pins init */
   uart0 = gap8_uart_initialize(0);
-  gap8_uart_setbaud(uart0, 115200, TARGET_CLK_HZ);
+  gap8_uart_setbaud(uart0, 115200, freq);
+  gap8_boot_stamp(GAP8_BOOT_CONSOLE);
+
+  /* The rest of the platform: system tick and software timers */
+  gap8_timer_initialize(freq, 1);
+  gap8_swtimer_initialize();
+
+  /* User code from here */
+  gap8_boot_stamp(GAP8_BOOT_USER);
+  gap8_boot_dump(uart0);
 
   gap8_uart_sendbytes(uart0, buf, strlen(buf));
   sprintf(cntbuf, "%dHz\r\n", gap8_getfreq());
   gap8_uart_sendbytes(uart0, cntbuf, strlen(cntbuf));
 
-  gap8_timer_initialize(TARGET_CLK_HZ, 1);
-  gap8_register_timercallback(on_timer, 0);
+  gap8_swtimer_init(&sec_timer, on_timer, 0);
+  gap8_swtimer_start(&sec_timer, 1, 1);
   while (1)
   {
       gap8_uart_recvbytes(uart0, getbuf, 1);
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+#
+# Symbolize the samples printed by gap8_pcprof_dump() into a flat profile.
+#
+#   pcprof.py test uart.log               flat profile by function
+#   pcprof.py --lines test uart.log       by source line
+#   pcprof.py --hot 32 test uart.log > hot_symbols.txt
+#
+# The log may hold anything else around the "pcprof begin" / "pcprof end"
+# block; the last block is used. Symbols come from `nm` of the cross
+# toolchain, source lines from `addr2line`.
+#
+# Author: hhuysqt <1020988872@qq.com>
+
+import argparse
+import bisect
+import subprocess
+import sys
+from collections import Counter
+
+CROSS = 'riscv32-unknown-elf-'
+
+
+def read_samples(path):
+    """Return (header, pc Counter, ra Counter) of the last block in the log"""
+    header, pc, ra = None, None, None
+    block = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            fields = line.split()
+            if fields[:2] == ['pcprof', 'begin']:
+                block = ([int(x) for x in fields[2:5]], Counter(), Counter())
+            elif fields[:2] == ['pcprof', 'end'] and block:
+                header, pc, ra = block
+                block = None
+            elif block and len(fields) == 3 and fields[0] in ('pc', 'ra'):
+                hist = block[1] if fields[0] == 'pc' else block[2]
+                hist[int(fields[1], 16)] += int(fields[2])
+    if header is None:
+        sys.exit('%s: no complete pcprof block' % path)
+    return header, pc, ra
+
+
+def read_symbols(elf, cross):
+    """Return the sorted function start addresses, and their (end, name)"""
+    out = subprocess.run([cross + 'nm', '-S', '-n', '--defined-only', elf],
+                         check=True, capture_output=True, text=True).stdout
+    starts, syms = [], []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in 'tTwW':
+            start, size = int(fields[0], 16), int(fields[1], 16)
+        elif len(fields) == 3 and fields[1] in 'tTwW':
+            # Assembly labels have no size, they end at the next symbol
+            start, size = int(fields[0], 16), 0
+        else:
+            continue
+        name = fields[-1]
+        if starts and starts[-1] == start:
+            # Aliases and linker markers: keep the sized one
+            if size:
+                syms[-1] = [start + size, name]
+            continue
+        starts.append(start)
+        syms.append([start + size, name])
+    for i in range(len(syms) - 1):
+        if syms[i][0] == starts[i]:
+            syms[i][0] = starts[i + 1]
+    return starts, syms
+
+
+def symbolize(hist, starts, syms):
+    prof = Counter()
+    for addr, count in hist.items():
+        i = bisect.bisect_right(starts, addr) - 1
+        if i >= 0 and addr < syms[i][0]:
+            prof[syms[i][1]] += count
+        else:
+            prof['[0x%08x]' % addr] += count
+    return prof
+
+
+def lines(hist, elf, cross):
+    addrs = sorted(hist)
+    out = subprocess.run([cross + 'addr2line', '-e', elf] +
+                         ['0x%x' % a for a in addrs],
+                         check=True, capture_output=True, text=True).stdout
+    prof = Counter()
+    for addr, line in zip(addrs, out.splitlines()):
+        prof[line] += hist[addr]
+    return prof
+
+
+def print_profile(title, prof, total):
+    print('%s: %d samples' % (title, total))
+    print('%8s %7s %7s  %s' % ('samples', '%', 'cum%', 'symbol'))
+    cum = 0
+    for name, count in prof.most_common():
+        cum += count
+        print('%8d %6.2f%% %6.2f%%  %s' %
+              (count, 100.0 * count / total, 100.0 * cum / total, name))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Symbolize gap8_pcprof_dump() samples into a flat profile')
+    parser.add_argument('elf')
+    parser.add_argument('log')
+    parser.add_argument('--cross', default=CROSS,
+                        help='toolchain prefix (default %(default)s)')
+    parser.add_argument('--lines', action='store_true',
+                        help='profile by source line instead of function')
+    parser.add_argument('--hot', type=int, metavar='N',
+                        help='print the N hottest functions for hot_symbols.txt')
+    args = parser.parse_args()
+
+    (samples, outside, shift), pc, ra = read_samples(args.log)
+    starts, syms = read_symbols(args.elf, args.cross)
+
+    if args.hot:
+        prof = symbolize(pc, starts, syms)
+        print('# %d samples, from %s' % (samples, args.log))
+        for name, count in prof.most_common(args.hot):
+            if not name.startswith('['):
+                print('%s %d' % (name, count))
+        return
+
+    print('%d samples, %d out of .text, %d-byte buckets\n' %
+          (samples, outside, 1 << shift))
+    total = sum(pc.values()) or 1
+    if args.lines:
+        print_profile('pc', lines(pc, args.elf, args.cross), total)
+    else:
+        print_profile('pc', symbolize(pc, starts, syms), total)
+    if ra:
+        print_profile('ra (callers)', symbolize(ra, starts, syms),
+                      sum(ra.values()))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Print where code and data landed: section sizes per memory, the FC TCDM
+# budget, and every object placed in FC TCDM. See gap8_section.h.
+#
+# Usage: placement_report.sh [elf] [cross prefix]
+
+ELF=${1:-test}
+CROSS=${2-riscv32-unknown-elf-}
+
+# Hex string to number. Non-GNU awk has neither strtonum() nor hex literals.
+HEX='function hex(s,  i, n) {
+  sub(/^0x/, "", s); s = tolower(s); n = 0
+  for (i = 1; i <= length(s); i++)
+    n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+  return n
+}
+function in_tcdm(name) { return name ~ /^\.(l1FcTiny|fcTcdmTiny|fcTcdm|fcTcdm_g|fcbss|heapfcram)$/ }'
+
+echo "== sections"
+${CROSS}size -A -x "$ELF" | awk "$HEX"'
+  $1 ~ /^\./ && $2 != "0x0" {
+    addr = hex($3)
+    if (addr >= 469762048 && addr < 470286336)    mem = "L2"   # 0x1C000000
+    else if (in_tcdm($1))                         mem = "FC TCDM"
+    else if (addr != 0)                           mem = "L1"
+    else                                          mem = "-"
+    printf "  %-20s %-8s %8d\n", $1, mem, hex($2)
+  }'
+
+echo "== FC TCDM budget (bytes)"
+${CROSS}nm "$ELF" | awk "$HEX"'
+  { sym[$3] = hex($1) }
+  END {
+    used  = sym["__heapfcram_start"] - 4
+    stack = sym["__fc_stack_start__"] - sym["__fc_stack_end__"]
+    irq   = sym["__irq_stack_start__"] - sym["__irq_stack_end__"]
+    printf "  data+bss %6d\n  stack    %6d\n  irqstack %6d\n",
+           used - stack - irq, stack, irq
+    printf "  free     %6d of 16380\n", 16380 - used
+  }'
+
+echo "== objects in FC TCDM"
+${CROSS}objdump -t "$ELF" | awk "$HEX"'
+  NF >= 5 && in_tcdm($(NF - 2)) && hex($(NF - 1)) != 0 {
+    printf "  %-10s %s %6d %s\n", $(NF - 2), $1, hex($(NF - 1)), $NF
+  }' | sort -k1,1 -k2,2